@@ -1,86 +1,898 @@
 #pragma once
 
+#include "serial.hpp"
+#include "stats.hpp"
+#include "weight_sum.hpp"
+
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
 #include <map>
 #include <memory>
-#include <stack>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 namespace nano
 {
-template <typename OBJ, typename VALIDATORS, typename CLOCK = std::chrono::system_clock, typename DURATION = std::chrono::milliseconds>
-class agreement : public std::enable_shared_from_this<agreement<OBJ, VALIDATORS, CLOCK, DURATION>>
+// Validator sets opt in to dense tally state by declaring a static constexpr bool dense = true and an index mapping each key to a small, dense integer
+// A const member index is called on the instance passed to the tally so each validator set, e.g. one per epoch, can number its own keys
+template<typename VALIDATORS, typename = void>
+class is_dense : public std::false_type
+{
+};
+template<typename VALIDATORS>
+class is_dense<VALIDATORS, std::enable_if_t<VALIDATORS::dense>> : public std::true_type
+{
+};
+// A static index numbers keys the same in every instance so a tally can find a validator's vote without being given the set
+template<typename VALIDATORS, typename = void>
+class has_static_index : public std::false_type
+{
+};
+template<typename VALIDATORS>
+class has_static_index<VALIDATORS, std::void_t<decltype (VALIDATORS::index (std::declval<typename VALIDATORS::key_type const &> ()))>> : public std::true_type
+{
+};
+// Objects from a small fixed domain are tallied in an array of weights instead of a ranked map
+// bool is covered, other types such as small enums opt in by specializing with size and an index mapping each value to [0, size) and back
+template<typename OBJ>
+class fixed_domain
+{
+public:
+	static bool constexpr value = false;
+};
+template<>
+class fixed_domain<bool>
+{
+public:
+	static bool constexpr value = true;
+	static size_t constexpr size = 2;
+	static size_t index (bool item)
+	{
+		return item;
+	}
+	static bool item (size_t index)
+	{
+		return index != 0;
+	}
+};
+template <typename AGREEMENT>
+class dag;
+// STATS receives counts and timings from the hot paths, stats_null compiles them away and stats<> keeps them for export
+// PARENTS false leaves out parent storage for agreements whose ancestry is held by a container, see core
+template <typename OBJ, typename VALIDATORS, typename CLOCK = std::chrono::system_clock, typename DURATION = std::chrono::milliseconds, typename STATS = stats_null, bool PARENTS = true>
+class agreement : public std::enable_shared_from_this<agreement<OBJ, VALIDATORS, CLOCK, DURATION, STATS, PARENTS>>
 {
 public:
 	using object = OBJ;
 	using validators = VALIDATORS;
 	using clock = CLOCK;
 	using duration = DURATION;
+	using stats = STATS;
 	using time_point = typename clock::time_point;
 	using validator = typename validators::key_type;
 	using weight = typename validators::mapped_type;
+	using sink_function = std::function<void(object const &, time_point const &, validator const &)>;
 	duration const W;
-	static void edge_null (time_point const &, std::unordered_map<object, weight> const &) {};
+	class tally;
+	// Edges borrow the tally being scanned, it's only valid for the duration of the call
+	static void edge_null (time_point const &, class tally const &) {};
 	static void fault_null (validator const &) {};
 	static void confirm_null (object const &, weight const &) {};
+	// Times an agreement progressed towards confirmation, each is time_point{} until it happens
+	class milestones
+	{
+	public:
+		// Earliest vote inserted
+		time_point first;
+		// First time a tally or the live window held quorum
+		time_point quorum;
+		// Time of the first confirmation
+		time_point confirmed;
+	};
 private:
-	std::multimap<time_point, std::pair<validator, object>> votes;
-	std::unordered_set<std::shared_ptr<agreement<object, validators, clock, duration>>> parents;
+	// A dag keeps its nodes' reach and cached roots in these fields of their cores, walk stamps live on dag::node::visited
+	template <typename>
+	friend class dag;
+	// Time ordered vote storage in contiguous memory
+	// Votes arriving in time order are appended, out of order votes are buffered and merged into place in one pass by flush
+	class vote_log
+	{
+	public:
+		using value_type = std::pair<time_point, std::pair<validator, object>>;
+		using iterator = typename std::vector<value_type>::const_iterator;
+	private:
+		std::vector<value_type> items;
+		std::vector<value_type> pending;
+		// Number of erased votes at the front of items, compacted once they outnumber the live votes
+		// Compacting also releases capacity left over from a burst once it's more than four times the live votes
+		size_t erased{ 0 };
+		static bool earlier (value_type const & lhs, value_type const & rhs)
+		{
+			return lhs.first < rhs.first;
+		}
+	public:
+		void emplace (time_point const & time, validator const & validator, object const & object)
+		{
+			if (items.size () == erased || !(time < items.back ().first))
+			{
+				items.emplace_back (time, std::make_pair (validator, object));
+			}
+			else
+			{
+				pending.emplace_back (time, std::make_pair (validator, object));
+			}
+		}
+		// Buffers a range of votes to be sorted and merged by the next flush
+		template<typename It>
+		void append (It first, It last)
+		{
+			for (auto i = first; i != last; ++i)
+			{
+				auto const & [object, time, validator] = *i;
+				pending.emplace_back (time, std::make_pair (validator, object));
+			}
+		}
+		// Merges buffered out of order votes, votes with equal times keep their insertion order
+		// A few late votes, as each message of a reordering network brings, are moved in to place without the sort and merge buffers
+		void flush ()
+		{
+			if (pending.size () <= 4)
+			{
+				for (auto const & item: pending)
+				{
+					items.insert (std::upper_bound (items.begin () + erased, items.end (), item, earlier), item);
+				}
+				pending.clear ();
+			}
+			else
+			{
+				std::stable_sort (pending.begin (), pending.end (), earlier);
+				auto size = items.size ();
+				auto merge = std::upper_bound (items.begin () + erased, items.end (), pending.front (), earlier) - items.begin ();
+				items.insert (items.end (), pending.begin (), pending.end ());
+				std::inplace_merge (items.begin () + merge, items.begin () + size, items.end (), earlier);
+				pending.clear ();
+			}
+		}
+		// Erases all votes before position
+		void erase (iterator position)
+		{
+			assert (pending.empty ());
+			erased = position - items.begin ();
+			if (erased >= items.size () - erased)
+			{
+				items.erase (items.begin (), items.begin () + erased);
+				erased = 0;
+				if (items.capacity () > 4 * items.size ())
+				{
+					items.shrink_to_fit ();
+				}
+			}
+		}
+		iterator begin () const
+		{
+			assert (pending.empty ());
+			return items.begin () + erased;
+		}
+		iterator end () const
+		{
+			assert (pending.empty ());
+			return items.end ();
+		}
+		iterator lower_bound (time_point const & time) const
+		{
+			return std::lower_bound (begin (), end (), time, [] (value_type const & lhs, time_point const & rhs) { return lhs.first < rhs; });
+		}
+		iterator upper_bound (time_point const & time) const
+		{
+			return std::upper_bound (begin (), end (), time, [] (time_point const & lhs, value_type const & rhs) { return lhs < rhs.first; });
+		}
+		size_t size () const
+		{
+			return items.size () - erased + pending.size ();
+		}
+		static void put (serial::writer & out, value_type const & value)
+		{
+			serial::put (out, value.first);
+			serial::put (out, value.second.first);
+			serial::put (out, value.second.second);
+		}
+		static void get (serial::reader & in, value_type & value)
+		{
+			serial::get (in, value.first);
+			serial::get (in, value.second.first);
+			serial::get (in, value.second.second);
+		}
+		static void put (serial::writer & out, std::vector<value_type> const & values, size_t offset = 0)
+		{
+			serial::put_size (out, values.size () - offset);
+			for (auto i = values.begin () + offset; i != values.end (); ++i)
+			{
+				put (out, *i);
+			}
+		}
+		static void get (serial::reader & in, std::vector<value_type> & values)
+		{
+			values.resize (serial::get_size (in));
+			for (auto & value: values)
+			{
+				get (in, value);
+			}
+		}
+		// Erased votes are dropped, buffered votes stay buffered
+		void save (serial::writer & out) const
+		{
+			put (out, items, erased);
+			put (out, pending);
+		}
+		// Stored votes must be in time order, buffered votes may be in any
+		void load (serial::reader & in)
+		{
+			erased = 0;
+			get (in, items);
+			get (in, pending);
+			if (!std::is_sorted (items.begin (), items.end (), earlier))
+			{
+				in.fail ();
+			}
+		}
+	};
+	// Set of parents holding up to two inline, larger sets move to a heap array
+	// Duplicates are removed on insertion by comparing pointers so lookups never hash
+	class parent_set
+	{
+	public:
+		using value_type = std::shared_ptr<agreement>;
+		using iterator = value_type *;
+		using const_iterator = value_type const *;
+	private:
+		static size_t constexpr inline_capacity = 2;
+		value_type items[inline_capacity];
+		std::unique_ptr<value_type[]> heap;
+		uint32_t size_m{ 0 };
+		uint32_t capacity{ inline_capacity };
+		void push_back (value_type const & value)
+		{
+			if (size_m == capacity)
+			{
+				auto grown = std::make_unique<value_type[]> (capacity * 2);
+				std::move (begin (), end (), grown.get ());
+				std::fill (std::begin (items), std::end (items), nullptr);
+				heap = std::move (grown);
+				capacity *= 2;
+			}
+			begin ()[size_m++] = value;
+		}
+	public:
+		iterator begin ()
+		{
+			return heap ? heap.get () : items;
+		}
+		iterator end ()
+		{
+			return begin () + size_m;
+		}
+		const_iterator begin () const
+		{
+			return heap ? heap.get () : items;
+		}
+		const_iterator end () const
+		{
+			return begin () + size_m;
+		}
+		size_t size () const
+		{
+			return size_m;
+		}
+		bool empty () const
+		{
+			return size_m == 0;
+		}
+		void insert (value_type const & value)
+		{
+			if (std::none_of (begin (), end (), [&value] (value_type const & item) { return item == value; }))
+			{
+				push_back (value);
+			}
+		}
+		template<typename It>
+		void insert (It first, It last)
+		{
+			std::for_each (first, last, [this] (value_type const & value) { push_back (value); });
+			if (size_m > inline_capacity)
+			{
+				std::sort (begin (), end ());
+				auto stop = std::unique (begin (), end ());
+				std::fill (stop, end (), nullptr);
+				size_m = stop - begin ();
+			}
+			else if (size_m == 2 && items[0] == items[1])
+			{
+				items[1] = nullptr;
+				size_m = 1;
+			}
+		}
+		void clear ()
+		{
+			std::fill (begin (), end (), nullptr);
+			heap.reset ();
+			size_m = 0;
+			capacity = inline_capacity;
+		}
+	};
+	// Always empty parents of a core
+	class parent_null
+	{
+	public:
+		using value_type = std::shared_ptr<agreement>;
+		using iterator = value_type *;
+		using const_iterator = value_type const *;
+		iterator begin () const
+		{
+			return nullptr;
+		}
+		iterator end () const
+		{
+			return nullptr;
+		}
+		size_t size () const
+		{
+			return 0;
+		}
+		bool empty () const
+		{
+			return true;
+		}
+		void clear ()
+		{
+		}
+	};
+	vote_log votes;
 	time_point time;
+	// Latest time a descendant's mark reached this agreement since its last reset
+	time_point reach;
+	// Value of resets when a mark last set reach, a mark only stops here if no agreement has been reset since
+	uint64_t epoch{ 0 };
+	// Resets of every agreement of this type, a reset ancestor can sit below the reach of its descendants
+	static inline std::atomic<uint64_t> resets{ 1 };
+	// Ancestor without parents cached by replaceable along with the value of its lineage when it was collected
+	class root
+	{
+	public:
+		agreement * item;
+		std::shared_ptr<uint64_t> lineage;
+		uint64_t seen;
+	};
+	// Every mark reaching an ancestor also reaches one of these so their reach bounds replaceable
+	// Rebuilt once any of their lineages moved, i.e. an agreement between them and this one replaced its parents or one of them was reset
+	std::vector<root> roots;
+	// Latest time or reach of the other ancestors when roots were collected, marks raising them later raise a root too but a reset root falls below them
+	time_point floor;
+	// Counter held while this agreement is a cached root, bumped when a descendant replaces its parents
+	// Shared with the caches so they can still be checked after this agreement is released
+	std::shared_ptr<uint64_t> lineage;
+	// Votes more than retention older than newest are released, a zero retention keeps every vote
+	duration retention{};
+	size_t batch{ 0 };
+	size_t unpruned{ 0 };
+	size_t pruned_m{ 0 };
+	// Latest now passed to advance or vote, vote timestamps aren't trusted to move the retention horizon
+	time_point newest;
+	// Called with every inserted vote, e.g. to append it to a journal
+	sink_function sink;
+	bool once{ false };
+	bool confirmed_m{ false };
+	bool roots_valid{ false };
+	std::conditional_t<PARENTS, parent_set, parent_null> parents;
+	milestones progress_m;
 public:
+	// Same agreement without parent storage, for containers such as dag tracking ancestry themselves and passing it to vote
+	using core = agreement<OBJ, VALIDATORS, CLOCK, DURATION, STATS, false>;
 	object last;
+	// Bytes held by each stored vote
+	static size_t constexpr vote_bytes = sizeof (typename vote_log::value_type);
 
 	using child = typename decltype(parents)::value_type;
 public:
 	// Transforms a sequence of rising and falling edges to an ordered weighted sum map
 	class tally
 	{
-		std::multimap<weight, object, std::greater<weight>> rank;
-		std::unordered_map<object, weight> totals_m;
-		std::unordered_map<validator, std::tuple<object, time_point, weight>> votes;
-
-		using vote = typename decltype(votes)::value_type;
+		// Objects ranked by total weight, among equal weights the object which has held its weight longest ranks first
+		class rank_map
+		{
+			std::multimap<weight, object, std::greater<weight>> rank;
+			std::unordered_map<object, weight> totals_m;
+			// Position of each object inside rank, weight changes move the entry directly instead of searching objects of equal weight
+			std::unordered_map<object, typename decltype(rank)::iterator> handles;
+		public:
+			template<typename OP>
+			void sort (weight const & weight, object const & object, OP op, uint64_t)
+			{
+				auto & weight_object = totals_m[object];
+				auto [handle, inserted] = handles.try_emplace (object);
+				assert (inserted == (weight_object == 0 && totals_m.size () == rank.size () + 1));
+				if (!inserted)
+				{
+					assert (handle->second->first == weight_object && handle->second->second == object);
+					rank.erase (handle->second);
+				}
+				auto weight_new = op (weight_object, weight);
+				handle->second = rank.insert (std::make_pair (weight_new, object));
+				assert (totals_m.size () == rank.size ());
+				weight_object = weight_new;
+			}
+			std::pair<weight, object> max () const
+			{
+				std::pair<weight, object> result{ weight{}, object{} };
+				if (!rank.empty ())
+				{
+					result = *rank.begin ();
+				}
+				return result;
+			}
+			decltype (totals_m) const & totals () const
+			{
+				return totals_m;
+			}
+			void clear ()
+			{
+				totals_m.clear ();
+				handles.clear ();
+				rank.clear ();
+			}
+			// Saved in rank order so ties between equal weights restore in the same order, totals and handles are rebuilt from it
+			void save (serial::writer & out) const
+			{
+				serial::put_size (out, rank.size ());
+				for (auto const & [weight, object]: rank)
+				{
+					serial::put (out, weight);
+					serial::put (out, object);
+				}
+			}
+			void load (serial::reader & in)
+			{
+				clear ();
+				auto size = serial::get_size (in);
+				totals_m.reserve (size);
+				handles.reserve (size);
+				for (size_t i = 0; i < size && !in.error (); ++i)
+				{
+					std::pair<weight, object> value;
+					serial::get (in, value.first);
+					serial::get (in, value.second);
+					// Entries must be in rank order and name each object once
+					if (!rank.empty () && rank.rbegin ()->first < value.first)
+					{
+						in.fail ();
+					}
+					auto handle = rank.insert (rank.end (), value);
+					if (!totals_m.emplace (value.second, value.first).second)
+					{
+						in.fail ();
+					}
+					handles[value.second] = handle;
+				}
+			}
+		};
+		// Same ranking for fixed domain objects, one weight per value and the stamp of its last change so ties resolve as in rank_map
+		class rank_array
+		{
+			using domain = fixed_domain<object>;
+			static uint64_t constexpr absent = std::numeric_limits<uint64_t>::max ();
+			std::array<std::pair<object, weight>, domain::size> totals_m;
+			std::array<uint64_t, domain::size> stamps;
+		public:
+			rank_array ()
+			{
+				clear ();
+			}
+			template<typename OP>
+			void sort (weight const & weight, object const & object, OP op, uint64_t stamp)
+			{
+				auto index = domain::index (object);
+				totals_m[index].second = op (totals_m[index].second, weight);
+				stamps[index] = stamp;
+			}
+			std::pair<weight, object> max () const
+			{
+				size_t best = 0;
+				for (size_t i = 1; i < domain::size; ++i)
+				{
+					auto better = (totals_m[i].second > totals_m[best].second) | ((totals_m[i].second == totals_m[best].second) & (stamps[i] < stamps[best]));
+					best = better ? i : best;
+				}
+				return stamps[best] == absent ? std::pair<weight, object>{ weight{}, object{} } : std::make_pair (totals_m[best].second, totals_m[best].first);
+			}
+			// Map-like view of the values voted for, the same entries rank_map::totals holds
+			class view
+			{
+				rank_array const * ranking;
+			public:
+				class iterator
+				{
+					rank_array const * ranking;
+					size_t index;
+					void skip ()
+					{
+						while (index < domain::size && ranking->stamps[index] == absent)
+						{
+							++index;
+						}
+					}
+				public:
+					using iterator_category = std::forward_iterator_tag;
+					using value_type = std::pair<object, weight>;
+					using difference_type = std::ptrdiff_t;
+					using pointer = value_type const *;
+					using reference = value_type const &;
+					iterator (rank_array const * ranking, size_t index) :
+					ranking{ ranking },
+					index{ index }
+					{
+						skip ();
+					}
+					reference operator* () const
+					{
+						return ranking->totals_m[index];
+					}
+					pointer operator-> () const
+					{
+						return &ranking->totals_m[index];
+					}
+					iterator & operator++ ()
+					{
+						++index;
+						skip ();
+						return *this;
+					}
+					iterator operator++ (int)
+					{
+						auto result = *this;
+						++*this;
+						return result;
+					}
+					bool operator== (iterator const & other) const
+					{
+						return index == other.index;
+					}
+					bool operator!= (iterator const & other) const
+					{
+						return index != other.index;
+					}
+				};
+				view (rank_array const & ranking) :
+				ranking{ &ranking }
+				{
+				}
+				iterator begin () const
+				{
+					return iterator{ ranking, 0 };
+				}
+				iterator end () const
+				{
+					return iterator{ ranking, domain::size };
+				}
+				iterator find (object const & item) const
+				{
+					auto index = domain::index (item);
+					return ranking->stamps[index] == absent ? end () : iterator{ ranking, index };
+				}
+				size_t count (object const & item) const
+				{
+					return find (item) != end ();
+				}
+				weight const & at (object const & item) const
+				{
+					auto existing = find (item);
+					if (existing == end ())
+					{
+						throw std::out_of_range{ "Object not voted for" };
+					}
+					return existing->second;
+				}
+				size_t size () const
+				{
+					return std::distance (begin (), end ());
+				}
+				bool empty () const
+				{
+					return begin () == end ();
+				}
+				bool operator== (view const & other) const
+				{
+					return std::equal (begin (), end (), other.begin (), other.end ());
+				}
+				bool operator!= (view const & other) const
+				{
+					return !(*this == other);
+				}
+				// Copies the entries out to the map rank_map::totals returns so code holding a copy of the totals works for either ranking
+				operator std::unordered_map<object, weight> () const
+				{
+					return std::unordered_map<object, weight>{ begin (), end () };
+				}
+			};
+			view totals () const
+			{
+				return view{ *this };
+			}
+			void clear ()
+			{
+				for (size_t i = 0; i < domain::size; ++i)
+				{
+					totals_m[i] = { domain::item (i), weight{} };
+				}
+				stamps.fill (absent);
+			}
+			void save (serial::writer & out) const
+			{
+				for (size_t i = 0; i < domain::size; ++i)
+				{
+					serial::put (out, totals_m[i].second);
+					serial::put (out, stamps[i]);
+				}
+			}
+			void load (serial::reader & in)
+			{
+				clear ();
+				for (size_t i = 0; i < domain::size; ++i)
+				{
+					serial::get (in, totals_m[i].second);
+					serial::get (in, stamps[i]);
+				}
+			}
+		};
+		std::conditional_t<fixed_domain<object>::value, rank_array, rank_map> ranking;
+		// Per-validator (object, time, weight) of the last vote risen, hashed by validator
+		class sparse_votes
+		{
+			std::unordered_map<validator, std::tuple<object, time_point, weight>> items;
+		public:
+			std::tuple<object &, time_point &, weight &> get (validator const & key, validators const &)
+			{
+				return get (key);
+			}
+			std::tuple<object &, time_point &, weight &> get (validator const & key)
+			{
+				auto & [current, time, weight] = items[key];
+				return std::tie (current, time, weight);
+			}
+			void assign (validator const &, validators const &, object & current, object const & item)
+			{
+				current = item;
+			}
+			template<typename UnaryPredicate>
+			bool all_of (UnaryPredicate p) const
+			{
+				return std::all_of (items.begin (), items.end (), [&p] (auto const & value) { return p (std::get<1> (value.second)); });
+			}
+			void clear ()
+			{
+				items.clear ();
+			}
+			// Written in key order so the bytes don't depend on the hash table's layout, which differs once reloaded
+			void save (serial::writer & out) const
+			{
+				std::vector<typename decltype (items)::const_pointer> sorted;
+				sorted.reserve (items.size ());
+				for (auto const & item: items)
+				{
+					sorted.push_back (&item);
+				}
+				std::sort (sorted.begin (), sorted.end (), [] (auto const & lhs, auto const & rhs) { return lhs->first < rhs->first; });
+				serial::put_size (out, sorted.size ());
+				for (auto item: sorted)
+				{
+					auto const & [key, value] = *item;
+					auto const & [current, time, weight] = value;
+					serial::put (out, key);
+					serial::put (out, current);
+					serial::put (out, time);
+					serial::put (out, weight);
+				}
+			}
+			void load (serial::reader & in)
+			{
+				clear ();
+				auto size = serial::get_size (in);
+				items.reserve (size);
+				for (size_t i = 0; i < size && !in.error (); ++i)
+				{
+					validator key;
+					serial::get (in, key);
+					auto & [current, time, weight] = items[key];
+					serial::get (in, current);
+					serial::get (in, time);
+					serial::get (in, weight);
+				}
+			}
+		};
+		// Same state held in flat arrays indexed by the validator set's index of each key, grown on first use of each index
+		class dense_votes
+		{
+			// Wrapped so a vector of bool objects still hands out references
+			class slot
+			{
+			public:
+				object value;
+			};
+			std::vector<slot> objects;
+			std::vector<time_point> times;
+			std::vector<weight> weights;
+			// Interned id of each validator's object and the objects in order of interning, read by recount
+			std::vector<uint32_t> ids;
+			std::vector<object> candidates;
+			std::unordered_map<object, uint32_t> interned;
+			uint32_t intern (object const & item)
+			{
+				auto [existing, inserted] = interned.try_emplace (item, static_cast<uint32_t> (candidates.size ()));
+				if (inserted)
+				{
+					candidates.push_back (item);
+				}
+				return existing->second;
+			}
+		public:
+			std::tuple<object &, time_point &, weight &> get (validator const & key, validators const & validators)
+			{
+				return at (validators.index (key));
+			}
+			// Only for validator sets with a static index
+			std::tuple<object &, time_point &, weight &> get (validator const & key)
+			{
+				return at (validators::index (key));
+			}
+			std::tuple<object &, time_point &, weight &> at (size_t index)
+			{
+				if (index >= times.size ())
+				{
+					objects.resize (index + 1);
+					times.resize (index + 1);
+					weights.resize (index + 1);
+					ids.resize (index + 1);
+				}
+				return std::tie (objects[index].value, times[index], weights[index]);
+			}
+			void assign (validator const & key, validators const & validators, object & current, object const & item)
+			{
+				current = item;
+				auto & id = ids[validators.index (key)];
+				if (id >= candidates.size () || !(candidates[id] == item))
+				{
+					id = intern (item);
+				}
+			}
+			template<typename UnaryPredicate>
+			bool all_of (UnaryPredicate p) const
+			{
+				return std::all_of (times.begin (), times.end (), p);
+			}
+			std::pair<weight, object> recount (weight_sum::isa use) const
+			{
+				std::pair<weight, object> result{ weight{}, object{} };
+				for (uint32_t id = 0; id < candidates.size (); ++id)
+				{
+					auto total = weight_sum::sum (ids.data (), weights.data (), ids.size (), id, use);
+					if (total > result.first)
+					{
+						result = { total, candidates[id] };
+					}
+				}
+				return result;
+			}
+			void clear ()
+			{
+				objects.clear ();
+				times.clear ();
+				weights.clear ();
+				ids.clear ();
+				candidates.clear ();
+				interned.clear ();
+			}
+			// The interning map is rebuilt from candidates
+			void save (serial::writer & out) const
+			{
+				serial::put_size (out, times.size ());
+				for (size_t i = 0; i < times.size (); ++i)
+				{
+					serial::put (out, objects[i].value);
+					serial::put (out, times[i]);
+					serial::put (out, weights[i]);
+					serial::put (out, ids[i]);
+				}
+				serial::put_size (out, candidates.size ());
+				for (auto const & item: candidates)
+				{
+					serial::put (out, item);
+				}
+			}
+			void load (serial::reader & in)
+			{
+				clear ();
+				auto size = serial::get_size (in);
+				objects.resize (size);
+				times.resize (size);
+				weights.resize (size);
+				ids.resize (size);
+				for (size_t i = 0; i < size; ++i)
+				{
+					serial::get (in, objects[i].value);
+					serial::get (in, times[i]);
+					serial::get (in, weights[i]);
+					serial::get (in, ids[i]);
+				}
+				candidates.resize (serial::get_size (in));
+				interned.reserve (candidates.size ());
+				for (uint32_t id = 0; id < candidates.size (); ++id)
+				{
+					serial::get (in, candidates[id]);
+					if (!interned.emplace (candidates[id], id).second)
+					{
+						in.fail ();
+					}
+				}
+			}
+		};
+		std::conditional_t<is_dense<validators>::value, dense_votes, sparse_votes> votes;
+		// Incremented every time an object's weight changes
+		uint64_t version_m{ 0 };
+		// Validators with a vote that has risen and not yet fallen
+		size_t active_m{ 0 };
 	private:
 		template<typename OP>
 		void sort (weight const & weight, object const & object, OP op)
 		{
-			auto & weight_object = totals_m[object];
-			auto [current, end] = rank.equal_range (weight_object);
-			while (current != end&& current->second != object)
-			{
-				++current;
-			}
-			assert ((current == rank.end () && weight_object == 0) || (current->first == weight_object && current->second == object));
-			if (current != end)
-			{
-				rank.erase (current);
-			}
-			auto weight_new = op (weight_object, weight);
-			rank.insert (std::make_pair (weight_new, object));
-			assert (totals_m.size () == rank.size ());
-			weight_object = weight_new;
+			ranking.sort (weight, object, op, ++version_m);
 		}
-	public:
-		void fall (time_point const & time, validator const & validator, object const & object)
+		void drop (std::tuple<object &, time_point &, weight &> vote, time_point const & time, object const & object)
 		{
-			auto & [current, time_l, weight_l] = votes[validator];
+			auto [current, time_l, weight_l] = vote;
 			if (time == time_l && object == current)
 			{
 				sort (weight_l, object, std::minus<weight> ());
+				if (time_l != time_point{})
+				{
+					--active_m;
+				}
 				time_l = time_point{};
+				weight_l = weight{};
 			}
 		}
+	public:
+		void fall (time_point const & time, validator const & validator, object const & object, validators const & validators)
+		{
+			drop (votes.get (validator, validators), time, object);
+		}
+		// Validator sets which are hashed or have a static index don't need to be passed to find the vote
+		template<typename V = validators, typename = std::enable_if_t<!is_dense<V>::value || has_static_index<V>::value>>
+		void fall (time_point const & time, validator const & validator, object const & object)
+		{
+			drop (votes.get (validator), time, object);
+		}
 		template<typename FAULT = decltype(fault_null)>
 		void rise (time_point const & time, validator const & validator, object const & object, validators const & validators, FAULT const & fault = fault_null)
 		{
-			auto & [current, time_l, weight_l] = votes[validator];
+			auto [current, time_l, weight_l] = votes.get (validator, validators);
 			if (time_l == time_point{})
 			{
-				current = object;
+				votes.assign (validator, validators, current, object);
 				time_l = time;
+				if (time_l != time_point{})
+				{
+					++active_m;
+				}
 				weight_l = validators.weight (validator);
 				sort (weight_l, object, std::plus<weight> ());
 			}
@@ -92,69 +904,317 @@ public:
 			{
 				sort (weight_l, current, std::minus<weight> ());
 				weight_l = 0;
+				stats::count (counter::faults);
+				fault (validator);
+			}
+		}
+		// Rises a vote arriving after a newer vote from the same validator has already risen, leaving the tally as a sweep in time order would have
+		// An older vote for the same object, or one which would have fallen before the newer vote rose, changes nothing
+		template<typename FAULT = decltype(fault_null)>
+		void rise_late (time_point const & time, validator const & validator, object const & object, validators const & validators, duration const & window, FAULT const & fault = fault_null)
+		{
+			auto [current, time_l, weight_l] = votes.get (validator, validators);
+			if (!(time < time_l))
+			{
+				rise (time, validator, object, validators, fault);
+			}
+			else if (current != object && time_l - time < window)
+			{
+				sort (weight_l, current, std::minus<weight> ());
+				weight_l = 0;
+				votes.assign (validator, validators, current, object);
+				time_l = time;
+				stats::count (counter::faults);
 				fault (validator);
 			}
 		}
 		bool empty () const
 		{
-			auto result = std::all_of (votes.begin (), votes.end (), [] (vote const & value) { return std::get<1>(value.second) == time_point{}; });
-			return result;
+			assert ((active_m == 0) == votes.all_of ([] (time_point const & time) { return time == time_point{}; }));
+			return active_m == 0;
+		}
+		// Number of validators currently voting, including faulty ones whose weight has been removed
+		size_t active () const
+		{
+			return active_m;
 		}
 		std::pair<weight, object> max () const
 		{
-			std::pair<weight, object> result{ weight{}, object{} };
-			if (!rank.empty ())
-			{
-				result = *rank.begin ();
-			}
-			return result;
+			return ranking.max ();
+		}
+		// Re-tallies every live vote from scratch with the vectorised weight kernel, returning the heaviest object and its total
+		// Only available for dense validators, ties go to the object first voted for
+		std::pair<weight, object> recount (weight_sum::isa use = weight_sum::best ()) const
+		{
+			static_assert (is_dense<validators>::value, "recount needs dense validators");
+			return votes.recount (use);
+		}
+		uint64_t version () const
+		{
+			return version_m;
 		}
-		decltype (totals_m) totals () const
+		// Weight of each object voted for, a map for most objects and a view of the same entries for fixed domains
+		// The view converts to the map type when a copy is needed
+		decltype (auto) totals () const
 		{
-			return totals_m;
+			return ranking.totals ();
 		}
 		void reset ()
 		{
 			votes.clear ();
-			totals_m.clear ();
-			rank.clear ();
+			ranking.clear ();
+			active_m = 0;
+		}
+		void save (serial::writer & out) const
+		{
+			ranking.save (out);
+			votes.save (out);
+			serial::put (out, version_m);
+			serial::put_size (out, active_m);
+		}
+		// Replaces this tally's state with one saved by save, returns false if the input was malformed
+		bool load (serial::reader & in)
+		{
+			ranking.load (in);
+			votes.load (in);
+			serial::get (in, version_m);
+			active_m = serial::get_size (in, 0);
+			return !in.error ();
 		}
 	};
 	
 private:
+	// Quorum hold state carried between successive edges
+	class hold_state
+	{
+	public:
+		bool holding{ false };
+		time_point set;
+		object obj;
+	};
+	// Persistent window over votes, every vote in [cursor - W, cursor] has risen in tally and every earlier vote has fallen
+	class window
+	{
+	public:
+		class tally tally;
+		hold_state state;
+		time_point cursor;
+		// Time and tally version of the last sample, edges which repeat it carry nothing new
+		time_point sampled;
+		uint64_t version{ 0 };
+		// Votes inserted at or behind the cursor since the last advance
+		std::vector<typename vote_log::value_type> late;
+	};
+	// Created by the first advance, agreements which are only ever tallied or voted on don't carry it
+	std::unique_ptr<window> live;
+	// Returns true if confirm was called
+	template<typename CONFIRM>
+	bool sample (hold_state & state, class tally const & tally, time_point const & time, validators const & validators, CONFIRM const & confirm, duration const & hold)
+	{
+		auto result = false;
+		auto const & [weight, object] = tally.max ();
+		auto holding_new = weight >= validators.quorum ();
+		if (holding_new && progress_m.quorum == time_point{})
+		{
+			progress_m.quorum = time;
+		}
+		if (state.holding && time - state.set >= hold && !(once && confirmed_m))
+		{
+			if (progress_m.confirmed == time_point{})
+			{
+				progress_m.confirmed = time;
+			}
+			confirm (state.obj, weight);
+			confirmed_m = true;
+			result = true;
+			if (!parents.empty ())
+			{
+				detach ();
+				parents.clear ();
+			}
+		}
+		if (!state.holding || state.obj != object)
+		{
+			state.set = time;
+			state.obj = object;
+		}
+		state.holding = holding_new;
+		return result;
+	}
+	// Calls edge, returns true if it asked for the sweep to stop by returning true
+	template<typename EDGE>
+	static bool emit (EDGE const & edge, time_point const & time, class tally const & tally)
+	{
+		stats::count (counter::edges);
+		if constexpr (std::is_same<decltype (edge (time, tally)), bool>::value)
+		{
+			return edge (time, tally);
+		}
+		else
+		{
+			edge (time, tally);
+			return false;
+		}
+	}
+	// Rises votes from current through end while falling votes from lower as they leave the window
+	// Stops early if an edge returns true, edges must not insert votes in to this agreement
+	template<typename EDGE, typename FAULT>
+	void sweep (class tally & tally, typename vote_log::iterator lower, typename vote_log::iterator current, time_point const & end, validators const & validators, EDGE const & edge, FAULT const & fault)
+	{
+		auto stop = votes.upper_bound (end);
+		while (current != stop)
+		{
+			auto const & [time, value] = *current;
+			auto const & [validator, object] = value;
+			while (lower->first <= time - W)
+			{
+				auto const & [time, value] = *lower;
+				auto const & [validator, object] = value;
+				tally.fall (time, validator, object, validators);
+				++lower;
+				if (lower == stop || lower->first != time)
+				{
+					if (emit (edge, time + W, tally))
+					{
+						return;
+					}
+				}
+			}
+			tally.rise (time, validator, object, validators, fault);
+			++current;
+			if (current == stop || current->first != time)
+			{
+				if (emit (edge, time, tally))
+				{
+					return;
+				}
+			}
+		}
+		while (lower != stop && lower->first + W < end)
+		{
+			auto const & [time, value] = *lower;
+			auto const & [validator, object] = value;
+			tally.fall (time, validator, object, validators);
+			++lower;
+			if (lower == stop || lower->first != time)
+			{
+				if (emit (edge, time + W, tally))
+				{
+					return;
+				}
+			}
+		}
+	}
 	template<typename UnaryFunction>
 	void for_each_ancestor (UnaryFunction f)
 	{
-		std::unordered_set<child> marked;
-		std::stack<child> work;
-		work.push (this->shared_from_this ());
+		typename stats::timer timer{ measure::walk };
+		uint64_t length = 0;
+		// Kept local so walks from agreements sharing ancestors only read them
+		std::unordered_set<agreement *> visited;
+		std::vector<agreement *> work{ this };
 		while (!work.empty ())
 		{
-			auto top = work.top ();
-			work.pop ();
-			std::for_each (top->parents.begin (), top->parents.end (), [&work, &marked] (child const & value) {
-				if (marked.find (value) == marked.end ())
+			auto top = work.back ();
+			work.pop_back ();
+			++length;
+			for (auto const & parent: top->parents)
+			{
+				if (visited.insert (parent.get ()).second)
 				{
-					marked.insert (value);
-					work.push (value);
+					work.push_back (parent.get ());
 				}
-			});
+			}
 			f (top);
 		}
+		stats::count (counter::ancestors, length);
+		stats::observe (measure::walk_length, length);
 	}
 	// Iteratively mark all ancestor agreements with the time this descendant was confirmed
+	// An ancestor already reached at or after now had all of its ancestors reached too, so the walk stops there unless an agreement was reset since
 	void mark (time_point const & now)
 	{
-		for_each_ancestor ([&now] (child const & value) { value->time = now; });
+		typename stats::timer timer{ measure::walk };
+		uint64_t length = 0;
+		auto current = resets.load (std::memory_order_relaxed);
+		time = now;
+		std::vector<agreement *> work{ this };
+		while (!work.empty ())
+		{
+			auto top = work.back ();
+			work.pop_back ();
+			++length;
+			for (auto const & parent: top->parents)
+			{
+				if (parent->reach < now || parent->epoch != current)
+				{
+					parent->reach = now;
+					parent->epoch = current;
+					work.push_back (parent.get ());
+				}
+			}
+		}
+		stats::count (counter::ancestors, length);
+		stats::observe (measure::walk_length, length);
+	}
+	// Moves the lineage of every root above this agreement before its parents are replaced, so only descendants sharing those roots rebuild their caches
+	// A root is its own only ancestor, so it skips the walk
+	void detach ()
+	{
+		if (parents.empty ())
+		{
+			if (lineage)
+			{
+				++*lineage;
+			}
+		}
+		else
+		{
+			for_each_ancestor ([] (agreement * value) {
+				if (value->parents.empty () && value->lineage)
+				{
+					++*value->lineage;
+				}
+			});
+		}
+		roots.clear ();
+		roots_valid = false;
 	}
-	// Iteratively test all ancestors to ensure this descendant can be replaced
+	// Test all ancestors to ensure this descendant can be replaced
+	// An agreement's own votes set its time and its descendants' votes its reach, both bound the result for it and its descendants
 	time_point replaceable ()
 	{
-		time_point result;
-		for_each_ancestor ([this, &result] (child const & value) {
-			auto cutoff = value->time + W;
-			result = std::max (result, cutoff);
-		});
+		auto result = std::max (time, reach) + W;
+		if (parents.empty ())
+		{
+			return result;
+		}
+		auto valid = roots_valid && std::all_of (roots.begin (), roots.end (), [] (root const & item) { return *item.lineage == item.seen; });
+		if (!valid)
+		{
+			roots.clear ();
+			floor = time_point{};
+			for_each_ancestor ([this] (agreement * value) {
+				if (value != this && value->parents.empty ())
+				{
+					if (!value->lineage)
+					{
+						value->lineage = std::make_shared<uint64_t> (0);
+					}
+					roots.push_back ({ value, value->lineage, *value->lineage });
+				}
+				else if (value != this)
+				{
+					floor = std::max (floor, std::max (value->time, value->reach));
+				}
+			});
+			roots_valid = true;
+		}
+		result = std::max (result, floor + W);
+		for (auto const & item: roots)
+		{
+			result = std::max (result, std::max (item.item->time, item.item->reach) + W);
+		}
 		return result;
 	}
 public:
@@ -168,111 +1228,378 @@ public:
 	agreement (duration const & window, object const & item, ParentIt first, ParentIt last) :
 	agreement{ window, item }
 	{
+		static_assert (PARENTS, "A core has no parents");
 		parents.insert (first, last);
 	}
-	agreement (duration const & window, object const & item, std::shared_ptr<agreement<object, validators, clock, duration>> parent) :
+	agreement (duration const & window, object const & item, std::shared_ptr<agreement> parent) :
 	agreement{ window, item }
 	{
+		static_assert (PARENTS, "A core has no parents");
 		parents.insert (parent);
 	}
+	// Forgets when this agreement last voted or was reached by a descendant's vote so it can switch objects once its ancestors allow
+	// Descendants caching it as a root collect their ancestors again since it may no longer bound them
 	void reset (object const & item)
 	{
 		time = time_point{};
+		reach = time_point{};
+		if (lineage)
+		{
+			++*lineage;
+		}
+		resets.fetch_add (1, std::memory_order_relaxed);
 		last = item;
+		confirmed_m = false;
+		progress_m = milestones{};
+	}
+	// When set, confirm is called at most once until the next reset and tally returns immediately once it has been
+	void confirm_once (bool value = true)
+	{
+		once = value;
+	}
+	// True if confirm has been called since construction or the last reset
+	bool confirmed () const
+	{
+		return confirmed_m;
+	}
+	// Progress since construction or the last reset, confirmed is set before confirm is called so it can be read from inside it
+	milestones const & progress () const
+	{
+		return progress_m;
+	}
+	// Writes every vote, tally and the live window to out, W and any write through are not included
+	// Parents are written as the id index (agreement const *) returns for them
+	template<typename INDEX>
+	void save (serial::writer & out, INDEX index) const
+	{
+		serial::put (out, last);
+		serial::put (out, time);
+		serial::put (out, reach);
+		serial::put (out, retention);
+		serial::put_size (out, batch);
+		serial::put_size (out, unpruned);
+		serial::put_size (out, pruned_m);
+		serial::put (out, newest);
+		serial::put (out, once);
+		serial::put (out, confirmed_m);
+		serial::put (out, progress_m.first);
+		serial::put (out, progress_m.quorum);
+		serial::put (out, progress_m.confirmed);
+		votes.save (out);
+		serial::put (out, live != nullptr);
+		if (live)
+		{
+			live->tally.save (out);
+			serial::put (out, live->state.holding);
+			serial::put (out, live->state.set);
+			serial::put (out, live->state.obj);
+			serial::put (out, live->cursor);
+			serial::put (out, live->sampled);
+			serial::put (out, live->version);
+			vote_log::put (out, live->late);
+		}
+		serial::put_size (out, parents.size ());
+		for (auto const & parent: parents)
+		{
+			serial::put (out, static_cast<uint64_t> (index (parent.get ())));
+		}
+	}
+	// Replaces this agreement's state with one written by save, parents are the agreements lookup (uint64_t) returns for each saved id
+	// Returns false if the input was malformed or a parent wasn't found
+	template<typename LOOKUP>
+	bool load (serial::reader & in, LOOKUP lookup)
+	{
+		serial::get (in, last);
+		serial::get (in, time);
+		serial::get (in, reach);
+		epoch = 0;
+		serial::get (in, retention);
+		batch = serial::get_size (in, 0);
+		unpruned = serial::get_size (in, 0);
+		pruned_m = serial::get_size (in, 0);
+		serial::get (in, newest);
+		serial::get (in, once);
+		serial::get (in, confirmed_m);
+		serial::get (in, progress_m.first);
+		serial::get (in, progress_m.quorum);
+		serial::get (in, progress_m.confirmed);
+		votes.load (in);
+		auto active = false;
+		serial::get (in, active);
+		live.reset ();
+		if (active)
+		{
+			live = std::make_unique<window> ();
+			live->tally.load (in);
+			serial::get (in, live->state.holding);
+			serial::get (in, live->state.set);
+			serial::get (in, live->state.obj);
+			serial::get (in, live->cursor);
+			serial::get (in, live->sampled);
+			serial::get (in, live->version);
+			vote_log::get (in, live->late);
+		}
+		auto result = true;
+		std::vector<child> loaded (serial::get_size (in, sizeof (uint64_t)));
+		for (auto & parent: loaded)
+		{
+			uint64_t id = 0;
+			serial::get (in, id);
+			parent = in.error () ? nullptr : lookup (id);
+			result = result && parent != nullptr;
+		}
+		if (!result)
+		{
+			loaded.clear ();
+		}
+		// Descendants may have cached roots through the old parents or this agreement itself as a root
+		detach ();
+		parents.clear ();
+		if constexpr (PARENTS)
+		{
+			parents.insert (loaded.begin (), loaded.end ());
+		}
+		else
+		{
+			// A core has nowhere to hold parents
+			result = result && loaded.empty ();
+		}
+		return result && !in.error ();
 	}
 	template<typename EDGE = decltype(edge_null), typename FAULT = decltype(fault_null)>
 	void scan (tally & tally, time_point const & begin, time_point const & end, validators const & validators, EDGE const & edge = edge_null, FAULT const & fault = fault_null)
 	{
+		typename stats::timer timer{ measure::scan };
+		votes.flush ();
 		auto current = votes.lower_bound (begin);
-		auto lower = current;
-		auto stop = votes.upper_bound (end);
-		while (current != stop)
+		sweep (tally, current, current, end, validators, edge, fault);
+	}
+	void insert (object const & item, time_point const & time, validator const & validator)
+	{
+		if (sink)
 		{
-			auto const & [time, value] = *current;
-			auto const & [validator, object] = value;
-			while (lower->first <= time - W)
+			sink (item, time, validator);
+		}
+		votes.emplace (time, validator, item);
+		if (progress_m.first == time_point{} || time < progress_m.first)
+		{
+			progress_m.first = time;
+		}
+		if (live && !(live->cursor < time))
+		{
+			live->late.emplace_back (time, std::make_pair (validator, item));
+		}
+		if (retention != duration{})
+		{
+			++unpruned;
+			collect ();
+		}
+	}
+	// Inserts a burst of (object, time, validator) votes, sorting and merging them in to the log in one pass, then advances the live window once to now
+	// Confirmation results are identical to inserting each vote individually followed by the same single advance, votes stamped after now wait for a later advance
+	template<typename It, typename CONFIRM = decltype(confirm_null), typename FAULT = decltype(fault_null)>
+	void insert_batch (It first, It last, time_point const & now, validators const & validators, CONFIRM const & confirm = confirm_null, FAULT const & fault = fault_null, duration const & hold = duration{})
+	{
+		votes.append (first, last);
+		size_t count = 0;
+		for (auto i = first; i != last; ++i, ++count)
+		{
+			auto const & [object, time, validator] = *i;
+			if (sink)
 			{
-				auto const & [time, value] = *lower;
-				auto const & [validator, object] = value;
-				tally.fall (time, validator, object);
-				++lower;
-				if (lower == stop || lower->first != time)
-				{
-					edge (time + W, tally.totals ());
-				}
+				sink (object, time, validator);
 			}
-			tally.rise (time, validator, object, validators, fault);
-			++current;
-			if (current == stop || current->first != time)
+			if (progress_m.first == time_point{} || time < progress_m.first)
 			{
-				edge (time, tally.totals ());
+				progress_m.first = time;
 			}
-		}
-		while (lower != stop && lower->first + W < end)
-		{
-			auto const & [time, value] = *lower;
-			auto const & [validator, object] = value;
-			tally.fall (time, validator, object);
-			++lower;
-			if (lower == stop || lower->first != time)
+			if (live && !(live->cursor < time))
 			{
-				edge (time + W, tally.totals ());
+				live->late.emplace_back (time, std::make_pair (validator, object));
 			}
 		}
+		if (retention != duration{})
+		{
+			unpruned += count;
+		}
+		advance (now, validators, confirm, fault, hold);
 	}
-	void insert (object const & item, time_point const & time, validator const & validator)
+	// Passes every vote inserted from now on to sink before storing it, an empty function stops writing through
+	// Votes replayed from a journal should be inserted before it's set so they aren't written twice
+	void write_through (sink_function const & sink)
+	{
+		this->sink = sink;
+	}
+	// Sets the retention horizon, votes older than the latest now passed to advance or vote by more than horizon are pruned once every batch inserts
+	// Nothing is pruned before the first advance or vote
+	// The horizon needs to cover the earliest begin passed to tally plus W for pruning to leave confirmation results unchanged
+	void retain (duration const & horizon, size_t batch = 1024)
+	{
+		retention = horizon;
+		this->batch = batch;
+	}
+private:
+	// Prunes behind the retention horizon once a full batch of votes has been inserted since the last prune
+	void collect ()
+	{
+		if (retention != duration{} && unpruned >= batch && newest != time_point{})
+		{
+			prune (newest - retention);
+		}
+	}
+public:
+	// Erases votes older than cutoff, returns the bytes held by the votes pruned
+	// Their storage is only released once the log compacts, so this isn't the memory freed by this call
+	// Votes still inside the live window are never erased
+	size_t prune (time_point const & cutoff)
+	{
+		unpruned = 0;
+		votes.flush ();
+		auto stop = votes.lower_bound (live ? std::min (cutoff, live->cursor - W) : cutoff);
+		auto result = (stop - votes.begin ()) * vote_bytes;
+		votes.erase (stop);
+		pruned_m += result;
+		return result;
+	}
+	// Total bytes held by the votes pruned over the lifetime of this agreement
+	size_t pruned_bytes () const
+	{
+		return pruned_m;
+	}
+	// Number of votes currently stored
+	size_t size () const
 	{
-		votes.emplace (std::make_pair (time, std::make_pair (validator, item)));
+		return votes.size ();
 	}
 	template<typename CONFIRM = decltype(confirm_null), typename FAULT = decltype(fault_null)>
 	void tally (time_point const & begin, time_point const & end, validators const & validators, CONFIRM const & confirm = confirm_null, FAULT const & fault = fault_null, duration const & hold = duration{})
 	{
+		typename stats::timer timer{ measure::tally };
+		if (once && confirmed_m)
+		{
+			return;
+		}
 		class tally tally;
-		bool holding = false;
-		time_point set;
-		object obj = last;
-		auto hold_sampler = [this, &obj, &hold, &holding, &set, &tally, &validators, &confirm] (time_point const & time, std::unordered_map<object, weight> const & totals) {
-			auto const & [weight, object] = tally.max ();
-			auto holding_new = weight >= validators.quorum ();
-			if (holding && time - set >= hold)
+		hold_state state;
+		state.obj = last;
+		// Scanning ends at the first confirmation so its cost follows how long quorum took to reach rather than the width of the range
+		auto hold_sampler = [this, &state, &hold, &tally, &validators, &confirm] (time_point const & time, class tally const &) {
+			return sample (state, tally, time, validators, confirm, hold);
+		};
+		scan (tally, begin, end, validators, hold_sampler, fault);
+	}
+	// Incremental equivalent of tally, moves a persistent window forward to now applying only the edges of votes entering or leaving it since the previous call
+	// Votes inserted at or behind the window's leading edge are risen on the next call if they have not yet expired
+	template<typename CONFIRM = decltype(confirm_null), typename FAULT = decltype(fault_null)>
+	void advance (time_point const & now, validators const & validators, CONFIRM const & confirm = confirm_null, FAULT const & fault = fault_null, duration const & hold = duration{})
+	{
+		typename stats::timer timer{ measure::advance };
+		// Falling edges at the trailing edge of the window can be revisited behind the cursor, they're sampled at the cursor so time never runs backwards
+		auto sampler = [this, &validators, &confirm, &hold] (time_point const & time, class tally const &) {
+			auto now = std::max (time, live->cursor);
+			if (now != live->sampled || live->tally.version () != live->version)
 			{
-				confirm (obj, weight);
-				parents.clear ();
+				sample (live->state, live->tally, now, validators, confirm, hold);
+				live->sampled = now;
+				live->version = live->tally.version ();
 			}
-			if (!holding || obj != object)
+		};
+		votes.flush ();
+		auto lower = votes.begin ();
+		auto current = votes.begin ();
+		if (live)
+		{
+			if (!live->late.empty ())
 			{
-				set = time;
-				obj = object;
+				for (auto const & [time, value]: live->late)
+				{
+					auto const & [validator, object] = value;
+					if (!(time < live->cursor - W))
+					{
+						live->tally.rise_late (time, validator, object, validators, W, fault);
+					}
+				}
+				live->late.clear ();
+				sampler (live->cursor, live->tally);
 			}
-			holding = holding_new;
-		};
-		scan (tally, begin, end, validators, hold_sampler, fault);
+			// Votes at exactly cursor - W may already have fallen, falling them again leaves the tally unchanged
+			lower = votes.lower_bound (live->cursor - W);
+			current = votes.upper_bound (live->cursor);
+		}
+		else
+		{
+			live = std::make_unique<window> ();
+			live->state.obj = last;
+		}
+		auto end = std::max (live->cursor, now);
+		sweep (live->tally, lower, current, end, validators, sampler, fault);
+		live->cursor = end;
+		newest = std::max (newest, now);
+		collect ();
+	}
+	// Earliest time an advance would reach an edge the live window hasn't applied, a vote rising or falling out, time_point::max () if there's none
+	// Advancing to any earlier time leaves the tally and confirmation unchanged, so callers can wait until then unless new votes arrive
+	// A vote exactly W behind the window may have already fallen, it makes the result one tick after the window at most once
+	time_point due ()
+	{
+		auto result = time_point::max ();
+		if (!live || (once && confirmed_m))
+		{
+			return result;
+		}
+		votes.flush ();
+		auto rise = votes.upper_bound (live->cursor);
+		if (rise != votes.end ())
+		{
+			result = rise->first;
+		}
+		// Advance falls a vote once it's strictly more than W behind the end of the window
+		auto fall = votes.lower_bound (live->cursor - W);
+		if (fall != votes.end () && fall->first + W + duration{ 1 } < result)
+		{
+			result = fall->first + W + duration{ 1 };
+		}
+		return result;
 	}
+	// Votes for the heaviest object in the window ending at now, returns when the vote expires or the time a blocked change to it is allowed
+	// The window includes both ends so at exactly the returned time the vote being replaced still counts, schedule the next vote one duration tick after it
+	// Voting writes the reach of every ancestor it marks and may create a root's lineage, agreements sharing ancestors need one lock over their DAG to vote concurrently
 	template<typename VoteFunction, typename FAULT = decltype(fault_null)>
 	time_point vote (VoteFunction const & vote, validators const & validators, time_point const & now = clock::now (), FAULT const & fault = fault_null)
 	{
-		//votes.erase (votes.begin (), votes.upper_bound (now - W));
+		return this->vote (vote, validators, now, [] () { return time_point{}; }, [] (time_point const &) {}, fault);
+	}
+	// Votes taking in to account ancestors held outside of this agreement's parents
+	// ancestors_replaceable returns the earliest time those ancestors allow this vote to change and ancestors_mark records a vote against them
+	template<typename VoteFunction, typename REPLACEABLE, typename MARK, typename FAULT = decltype(fault_null)>
+	time_point vote (VoteFunction const & vote, validators const & validators, time_point const & now, REPLACEABLE const & ancestors_replaceable, MARK const & ancestors_mark, FAULT const & fault = fault_null)
+	{
+		typename stats::timer timer{ measure::vote };
+		newest = std::max (newest, now);
 		class tally tally;
 		scan (tally, now - W, now, validators, edge_null, fault);
 		auto const & [weight, object] = tally.max ();
 		auto result = now + W;
 		if (last != object)
 		{
-			auto when = replaceable ();
+			auto when = std::max (replaceable (), ancestors_replaceable ());
 			if (when <= now)
 			{
 				last = object;
 				mark (now);
+				ancestors_mark (now);
 				vote (last, now);
 			}
 			else
 			{
+				stats::count (counter::suppressed);
 				result = when;
 			}
 		}
 		else
 		{
 			mark (now);
+			ancestors_mark (now);
 			vote (last, now);
 		}
 		return result;
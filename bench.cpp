@@ -0,0 +1,1035 @@
+#include "agreement.hpp"
+#include "concurrent.hpp"
+#include "dag.hpp"
+#include "edges.hpp"
+#include "elections.hpp"
+#include "journal.hpp"
+#include "simulator.hpp"
+#include "snapshot.hpp"
+#include "timer_wheel.hpp"
+#include "weight_sum.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+class uniform_validators
+{
+	size_t count;
+
+public:
+	using key_type = unsigned;
+	using mapped_type = unsigned;
+	uniform_validators (size_t count) :
+	count{ count }
+	{
+	}
+	unsigned weight (unsigned const &) const
+	{
+		return 1;
+	}
+	unsigned quorum () const
+	{
+		return count - ((count - 1) / 3);
+	}
+	size_t size () const
+	{
+		return count;
+	}
+};
+
+// Same validators with dense tally state, keys are already 0..count - 1 so tallies keep per-validator state in flat arrays
+class dense_validators : public uniform_validators
+{
+public:
+	using uniform_validators::uniform_validators;
+	static bool constexpr dense = true;
+	static size_t index (unsigned const & validator)
+	{
+		return validator;
+	}
+};
+
+// Benchmarks of the tally paths are instantiated for both the default hashed and the dense per-validator state
+template<typename VALIDATORS>
+using agreement_v_t = nano::agreement<uint32_t, VALIDATORS, std::chrono::steady_clock>;
+using agreement_t = agreement_v_t<uniform_validators>;
+using dag_t = nano::dag<agreement_t>;
+using elections_t = nano::elections<agreement_t, uint64_t>;
+using time_point = agreement_t::time_point;
+using ms = std::chrono::milliseconds;
+
+// First vote time, time_point{} is reserved
+time_point const start{ std::chrono::hours{ 1 } };
+auto const vote_null = [] (agreement_t::object const &, time_point const &) {};
+
+// Votes from count validators, one per millisecond each in time order, for objects drawn from cardinality
+std::vector<std::tuple<uint32_t, time_point, unsigned>> votes (size_t total, size_t count, uint32_t cardinality, uint64_t seed = 0)
+{
+	std::mt19937_64 random{ seed };
+	std::uniform_int_distribution<uint32_t> dist{ 0, cardinality - 1 };
+	std::vector<std::tuple<uint32_t, time_point, unsigned>> result;
+	result.reserve (total);
+	for (size_t i = 0; i < total; ++i)
+	{
+		result.emplace_back (dist (random), start + ms{ i / count }, static_cast<unsigned> (i % count));
+	}
+	return result;
+}
+
+// Agreement holding total votes from votes ()
+template<typename VALIDATORS>
+std::unique_ptr<agreement_v_t<VALIDATORS>> populated (ms const & W, size_t total, size_t count, uint32_t cardinality)
+{
+	auto result = std::make_unique<agreement_v_t<VALIDATORS>> (W, 0);
+	for (auto const & [item, time, validator]: votes (total, count, cardinality))
+	{
+		result->insert (item, time, validator);
+	}
+	return result;
+}
+
+// Nodes each create benchmark keeps alive before releasing them untimed, so both hold the same number and memory stays bounded
+size_t constexpr create_batch = 10'000;
+
+// Args: parents
+void create (benchmark::State & state)
+{
+	std::array<std::shared_ptr<agreement_t>, 2> parents{ std::make_shared<agreement_t> (ms{ 50 }, 0), std::make_shared<agreement_t> (ms{ 50 }, 1) };
+	auto count = static_cast<size_t> (state.range (0));
+	std::vector<std::shared_ptr<agreement_t>> created;
+	created.reserve (create_batch);
+	for (auto _: state)
+	{
+		if (created.size () == create_batch)
+		{
+			state.PauseTiming ();
+			created.clear ();
+			state.ResumeTiming ();
+		}
+		created.push_back (std::make_shared<agreement_t> (ms{ 50 }, 2, parents.begin (), parents.begin () + count));
+	}
+	state.SetItemsProcessed (state.iterations ());
+}
+BENCHMARK (create)->ArgName ("parents")->DenseRange (0, 2);
+
+// Args: parents
+void dag_create (benchmark::State & state)
+{
+	auto count = static_cast<size_t> (state.range (0));
+	std::optional<dag_t> dag;
+	std::array<dag_t::handle, 2> parents;
+	size_t created = create_batch;
+	for (auto _: state)
+	{
+		if (created == create_batch)
+		{
+			state.PauseTiming ();
+			dag.emplace (ms{ 50 });
+			parents = { dag->insert (0), dag->insert (1) };
+			created = 0;
+			state.ResumeTiming ();
+		}
+		benchmark::DoNotOptimize (dag->insert (2, parents.begin (), parents.begin () + count));
+		++created;
+	}
+	state.SetItemsProcessed (state.iterations ());
+}
+BENCHMARK (dag_create)->ArgName ("parents")->DenseRange (0, 2);
+
+// Args: agreements
+// Grows a dag of agreements each with two random parents, every 10k tallying and dropping the oldest half
+void generate_2_parents (benchmark::State & state)
+{
+	auto count = state.range (0);
+	uniform_validators validators{ 1 };
+	std::mt19937_64 random{ 0 };
+	for (auto _: state)
+	{
+		std::deque<std::shared_ptr<agreement_t>> inserted{ std::make_shared<agreement_t> (ms{ 50 }, 0), std::make_shared<agreement_t> (ms{ 50 }, 1) };
+		for (int64_t i = 0; i < count; ++i)
+		{
+			if ((i + 1) % 10'000 == 0)
+			{
+				for (size_t j = 0, n = inserted.size () / 2; j < n; ++j)
+				{
+					inserted.front ()->tally (start, start, validators);
+					inserted.pop_front ();
+				}
+			}
+			std::uniform_int_distribution<size_t> dist{ 0, inserted.size () - 1 };
+			std::array<std::shared_ptr<agreement_t>, 2> parents{ inserted[dist (random)], inserted[dist (random)] };
+			inserted.push_back (std::make_shared<agreement_t> (ms{ 50 }, static_cast<uint32_t> (i), parents.begin (), parents.end ()));
+		}
+	}
+	state.SetItemsProcessed (state.iterations () * count);
+}
+BENCHMARK (generate_2_parents)->ArgName ("agreements")->Arg (200'000)->Unit (benchmark::kMillisecond);
+
+// Args: agreements
+// Grows a dag of agreements each with a random number of the oldest agreements as parents, every 1k tallying and dropping the oldest half
+void generate_n_parents (benchmark::State & state)
+{
+	auto count = state.range (0);
+	uniform_validators validators{ 1 };
+	std::mt19937_64 random{ 0 };
+	for (auto _: state)
+	{
+		std::deque<std::shared_ptr<agreement_t>> inserted{ std::make_shared<agreement_t> (ms{ 50 }, 0) };
+		for (int64_t i = 0; i < count; ++i)
+		{
+			if ((i + 1) % 1'000 == 0)
+			{
+				for (size_t j = 0, n = inserted.size () / 2; j < n; ++j)
+				{
+					inserted.front ()->tally (start, start, validators);
+					inserted.pop_front ();
+				}
+			}
+			std::uniform_int_distribution<size_t> dist{ 0, inserted.size () - 1 };
+			auto parents = dist (random);
+			inserted.push_back (std::make_shared<agreement_t> (ms{ 50 }, static_cast<uint32_t> (i), inserted.begin (), inserted.begin () + parents));
+		}
+	}
+	state.SetItemsProcessed (state.iterations () * count);
+}
+BENCHMARK (generate_n_parents)->ArgName ("agreements")->Arg (10'000)->Unit (benchmark::kMillisecond);
+
+// Args: validators, W
+// Inserts votes in time order, pruning 2W behind the newest vote after each pass so the log stays the size of a few windows
+void insert (benchmark::State & state)
+{
+	auto count = static_cast<size_t> (state.range (0));
+	ms W{ state.range (1) };
+	auto input = votes (1 << 16, count, 2);
+	agreement_t item{ W, 0 };
+	uint64_t offset = 0;
+	for (auto _: state)
+	{
+		for (auto const & [value, time, validator]: input)
+		{
+			item.insert (value, time + ms{ offset }, validator);
+		}
+		item.prune (std::get<1> (input.back ()) + ms{ offset } - W - W);
+		offset += input.size () / count + 1;
+	}
+	state.SetItemsProcessed (state.iterations () * input.size ());
+}
+BENCHMARK (insert)->ArgNames ({ "validators", "W" })->ArgsProduct ({ { 10, 100, 1'000 }, { 50, 500 } });
+
+// Args: validators
+// Each vote is followed by advancing the live window to it, as when votes are processed one at a time
+template<typename VALIDATORS>
+void insert_advance (benchmark::State & state)
+{
+	auto count = static_cast<size_t> (state.range (0));
+	VALIDATORS validators{ count };
+	auto input = votes (1 << 16, count, 2);
+	agreement_v_t<VALIDATORS> item{ ms{ 50 }, 0 };
+	item.retain (ms{ 100 });
+	uint64_t offset = 0;
+	for (auto _: state)
+	{
+		for (auto const & [value, time, validator]: input)
+		{
+			item.insert (value, time + ms{ offset }, validator);
+			item.advance (time + ms{ offset }, validators);
+		}
+		offset += input.size () / count + 1;
+	}
+	state.SetItemsProcessed (state.iterations () * input.size ());
+}
+BENCHMARK_TEMPLATE (insert_advance, uniform_validators)->ArgName ("validators")->RangeMultiplier (10)->Range (10, 1'000);
+BENCHMARK_TEMPLATE (insert_advance, dense_validators)->ArgName ("validators")->RangeMultiplier (10)->Range (10, 1'000);
+
+// One validator repeats the same vote, each duplicate is followed by advancing the live window to it and never confirms
+void duplicates (benchmark::State & state)
+{
+	uniform_validators validators{ 4 };
+	agreement_t item{ ms{ 50 }, 0 };
+	size_t confirms = 0;
+	auto confirm = [&confirms] (uint32_t const &, unsigned const &) { ++confirms; };
+	for (auto _: state)
+	{
+		item.insert (0, start, 0);
+		item.advance (start, validators, confirm);
+	}
+	if (confirms != 0)
+	{
+		state.SkipWithError ("Duplicate votes confirmed");
+	}
+	state.SetItemsProcessed (state.iterations ());
+}
+BENCHMARK (duplicates);
+
+// Args: validators, batch
+template<typename VALIDATORS>
+void insert_batch (benchmark::State & state)
+{
+	auto count = static_cast<size_t> (state.range (0));
+	auto size = static_cast<size_t> (state.range (1));
+	VALIDATORS validators{ count };
+	auto input = votes (1 << 16, count, 2);
+	agreement_v_t<VALIDATORS> item{ ms{ 50 }, 0 };
+	item.retain (ms{ 100 });
+	std::vector<std::tuple<uint32_t, time_point, unsigned>> batch;
+	uint64_t offset = 0;
+	for (auto _: state)
+	{
+		for (size_t i = 0; i < input.size (); i += size)
+		{
+			batch.clear ();
+			for (size_t j = i, n = std::min (input.size (), i + size); j < n; ++j)
+			{
+				auto const & [value, time, validator] = input[j];
+				batch.emplace_back (value, time + ms{ offset }, validator);
+			}
+			item.insert_batch (batch.begin (), batch.end (), std::get<1> (batch.back ()), validators);
+		}
+		offset += input.size () / count + 1;
+	}
+	state.SetItemsProcessed (state.iterations () * input.size ());
+}
+BENCHMARK_TEMPLATE (insert_batch, uniform_validators)->ArgNames ({ "validators", "batch" })->ArgsProduct ({ { 100, 1'000 }, { 10, 500 } });
+BENCHMARK_TEMPLATE (insert_batch, dense_validators)->ArgNames ({ "validators", "batch" })->ArgsProduct ({ { 100, 1'000 }, { 10, 500 } });
+
+// Args: validators, W
+// Scans every edge of 2^18 votes
+template<typename VALIDATORS>
+void scan (benchmark::State & state)
+{
+	auto count = static_cast<size_t> (state.range (0));
+	ms W{ state.range (1) };
+	VALIDATORS validators{ count };
+	auto item = populated<VALIDATORS> (W, 1 << 18, count, 2);
+	for (auto _: state)
+	{
+		size_t edges = 0;
+		typename agreement_v_t<VALIDATORS>::tally tally;
+		item->scan (tally, time_point::min (), time_point::max (), validators, [&edges] (time_point const &, typename agreement_v_t<VALIDATORS>::tally const &) { ++edges; });
+		benchmark::DoNotOptimize (edges);
+	}
+	state.SetItemsProcessed (state.iterations () * item->size ());
+}
+BENCHMARK_TEMPLATE (scan, uniform_validators)->ArgNames ({ "validators", "W" })->ArgsProduct ({ { 10, 100, 1'000 }, { 50, 500 } });
+BENCHMARK_TEMPLATE (scan, dense_validators)->ArgNames ({ "validators", "W" })->ArgsProduct ({ { 10, 100, 1'000 }, { 50, 500 } });
+
+// Args: votes
+// Inserts votes from 1000 validators up to 2ms out of time order in to an empty log, then scans every edge
+template<typename VALIDATORS>
+void insert_scan (benchmark::State & state)
+{
+	auto count = static_cast<size_t> (state.range (0));
+	VALIDATORS validators{ 1'000 };
+	auto input = votes (count, 1'000, 2);
+	std::mt19937_64 random{ 0 };
+	std::uniform_int_distribution<int> jitter{ 0, 2 };
+	for (auto & [value, time, validator]: input)
+	{
+		time -= ms{ jitter (random) };
+	}
+	for (auto _: state)
+	{
+		agreement_v_t<VALIDATORS> item{ ms{ 50 }, 0 };
+		for (auto const & [value, time, validator]: input)
+		{
+			item.insert (value, time, validator);
+		}
+		size_t edges = 0;
+		typename agreement_v_t<VALIDATORS>::tally tally;
+		item.scan (tally, time_point::min (), time_point::max (), validators, [&edges] (time_point const &, typename agreement_v_t<VALIDATORS>::tally const &) { ++edges; });
+		benchmark::DoNotOptimize (edges);
+	}
+	state.SetItemsProcessed (state.iterations () * count);
+}
+BENCHMARK_TEMPLATE (insert_scan, uniform_validators)->ArgName ("votes")->Arg (1'000'000)->Unit (benchmark::kMillisecond);
+BENCHMARK_TEMPLATE (insert_scan, dense_validators)->ArgName ("votes")->Arg (1'000'000)->Unit (benchmark::kMillisecond);
+
+// Args: validators, cardinality
+// Tallies 2^18 votes over a range, a cardinality of 1 confirms within the first W and larger domains rarely reach quorum so scan the whole range
+template<typename VALIDATORS>
+void tally (benchmark::State & state)
+{
+	auto count = static_cast<size_t> (state.range (0));
+	auto cardinality = static_cast<uint32_t> (state.range (1));
+	VALIDATORS validators{ count };
+	auto item = populated<VALIDATORS> (ms{ 50 }, 1 << 18, count, cardinality);
+	for (auto _: state)
+	{
+		size_t confirms = 0;
+		item->tally (time_point::min (), time_point::max (), validators, [&confirms] (uint32_t const &, unsigned const &) { ++confirms; });
+		benchmark::DoNotOptimize (confirms);
+	}
+}
+BENCHMARK_TEMPLATE (tally, uniform_validators)->ArgNames ({ "validators", "cardinality" })->ArgsProduct ({ { 10, 1'000 }, { 1, 2, 16, 1'024 } });
+BENCHMARK_TEMPLATE (tally, dense_validators)->ArgNames ({ "validators", "cardinality" })->ArgsProduct ({ { 10, 1'000 }, { 1, 2, 16, 1'024 } });
+
+// Args: cardinality
+// Each validator holds a vote for one of cardinality objects, then votes fall and rise again and the maximum is read after each change
+// There are at least as many validators as objects so every object is held
+template<typename VALIDATORS>
+void tally_rank (benchmark::State & state)
+{
+	auto cardinality = static_cast<uint32_t> (state.range (0));
+	auto count = std::max<unsigned> (10'000, cardinality);
+	VALIDATORS validators{ count };
+	typename agreement_v_t<VALIDATORS>::tally tally;
+	for (unsigned i = 0; i < count; ++i)
+	{
+		tally.rise (start, i, i % cardinality, validators);
+	}
+	std::mt19937_64 random{ 0 };
+	std::uniform_int_distribution<unsigned> dist{ 0, count - 1 };
+	for (auto _: state)
+	{
+		auto validator = dist (random);
+		tally.fall (start, validator, validator % cardinality, validators);
+		tally.rise (start, validator, validator % cardinality, validators);
+		benchmark::DoNotOptimize (tally.max ());
+	}
+	state.SetItemsProcessed (state.iterations ());
+}
+BENCHMARK_TEMPLATE (tally_rank, uniform_validators)->ArgName ("cardinality")->RangeMultiplier (16)->Range (2, 100'000);
+BENCHMARK_TEMPLATE (tally_rank, dense_validators)->ArgName ("cardinality")->RangeMultiplier (16)->Range (2, 100'000);
+
+// Ranking tally used before it tracked a handle per object, equally weighted objects are found by a linear search of a multimap
+class rank_multimap
+{
+	std::multimap<unsigned, uint32_t, std::greater<unsigned>> rank;
+	std::unordered_map<uint32_t, unsigned> totals;
+
+public:
+	template<typename OP>
+	void sort (unsigned const & weight, uint32_t const & object, OP op)
+	{
+		auto & weight_object = totals[object];
+		auto [current, end] = rank.equal_range (weight_object);
+		while (current != end && current->second != object)
+		{
+			++current;
+		}
+		if (current != end)
+		{
+			rank.erase (current);
+		}
+		auto weight_new = op (weight_object, weight);
+		rank.insert (std::make_pair (weight_new, object));
+		weight_object = weight_new;
+	}
+	std::pair<unsigned, uint32_t> max () const
+	{
+		return *rank.begin ();
+	}
+};
+
+// Args: cardinality
+// Same changes as tally_rank made to the multimap ranking
+void tally_multimap (benchmark::State & state)
+{
+	auto cardinality = static_cast<uint32_t> (state.range (0));
+	auto count = std::max<unsigned> (10'000, cardinality);
+	rank_multimap rank;
+	for (unsigned i = 0; i < count; ++i)
+	{
+		rank.sort (1, i % cardinality, std::plus<unsigned> ());
+	}
+	std::mt19937_64 random{ 0 };
+	std::uniform_int_distribution<unsigned> dist{ 0, count - 1 };
+	for (auto _: state)
+	{
+		auto validator = dist (random);
+		rank.sort (1, validator % cardinality, std::minus<unsigned> ());
+		rank.sort (1, validator % cardinality, std::plus<unsigned> ());
+		benchmark::DoNotOptimize (rank.max ());
+	}
+	state.SetItemsProcessed (state.iterations ());
+}
+BENCHMARK (tally_multimap)->ArgName ("cardinality")->RangeMultiplier (16)->Range (2, 100'000);
+
+// 1000 validators flip between two objects and the maximum is read after each change
+// bool objects are tallied in an array of weights, uint32_t in the ranked map
+template<typename OBJ>
+void tally_binary (benchmark::State & state)
+{
+	size_t constexpr count = 1'000;
+	uniform_validators validators{ count };
+	class nano::agreement<OBJ, uniform_validators, std::chrono::steady_clock>::tally tally;
+	for (unsigned i = 0; i < count; ++i)
+	{
+		tally.rise (start, i, static_cast<OBJ> (i % 2), validators);
+	}
+	uint64_t i = 0;
+	for (auto _: state)
+	{
+		auto validator = static_cast<unsigned> (i % count);
+		auto item = static_cast<OBJ> ((i / count + validator) % 2);
+		tally.fall (start, validator, item, validators);
+		tally.rise (start, validator, static_cast<OBJ> (!item), validators);
+		benchmark::DoNotOptimize (tally.max ());
+		++i;
+	}
+	state.SetItemsProcessed (state.iterations ());
+}
+BENCHMARK_TEMPLATE (tally_binary, bool);
+BENCHMARK_TEMPLATE (tally_binary, uint32_t);
+
+// Args: validators
+// Full re-tally of validators split over three objects, labelled with the weight sum kernel used
+void recount (benchmark::State & state)
+{
+	auto count = static_cast<size_t> (state.range (0));
+	dense_validators validators{ count };
+	class agreement_v_t<dense_validators>::tally tally;
+	for (unsigned i = 0; i < count; ++i)
+	{
+		tally.rise (start, i, i % 5 == 0 ? 2 : i % 3 == 0 ? 1 : 0, validators);
+	}
+	for (auto _: state)
+	{
+		benchmark::DoNotOptimize (tally.recount ());
+	}
+	state.SetItemsProcessed (state.iterations () * count);
+	state.SetLabel (nano::weight_sum::name (nano::weight_sum::best ()));
+}
+BENCHMARK (recount)->ArgName ("validators")->RangeMultiplier (10)->Range (100, 10'000);
+
+// Args: validators, W
+// Votes once per millisecond with every validator's votes for the last W in the log
+template<typename VALIDATORS>
+void vote (benchmark::State & state)
+{
+	auto count = static_cast<size_t> (state.range (0));
+	ms W{ state.range (1) };
+	VALIDATORS validators{ count };
+	auto total = count * static_cast<size_t> (W.count ()) * 4;
+	auto item = populated<VALIDATORS> (W, total, count, 2);
+	auto end = start + ms{ total / count };
+	auto now = end - W;
+	for (auto _: state)
+	{
+		benchmark::DoNotOptimize (item->vote (vote_null, validators, now));
+		now = now + ms{ 1 } < end ? now + ms{ 1 } : end - W;
+	}
+	state.SetItemsProcessed (state.iterations ());
+}
+BENCHMARK_TEMPLATE (vote, uniform_validators)->ArgNames ({ "validators", "W" })->ArgsProduct ({ { 10, 100, 1'000 }, { 50, 500 } });
+BENCHMARK_TEMPLATE (vote, dense_validators)->ArgNames ({ "validators", "W" })->ArgsProduct ({ { 10, 100, 1'000 }, { 50, 500 } });
+
+// Args: depth
+// Votes on the tip of a chain of depth agreements, every vote is later than the last so marking walks every ancestor
+void ancestors (benchmark::State & state)
+{
+	auto depth = state.range (0);
+	uniform_validators validators{ 1 };
+	std::vector<std::shared_ptr<agreement_t>> chain{ std::make_shared<agreement_t> (ms{ 50 }, 0) };
+	for (int64_t i = 1; i < depth; ++i)
+	{
+		chain.push_back (std::make_shared<agreement_t> (ms{ 50 }, 0, chain.back ()));
+	}
+	auto now = start;
+	for (auto _: state)
+	{
+		now = now + ms{ 1 };
+		benchmark::DoNotOptimize (chain.back ()->vote (vote_null, validators, now));
+	}
+	state.SetItemsProcessed (state.iterations () * depth);
+}
+BENCHMARK (ancestors)->ArgName ("depth")->RangeMultiplier (10)->Range (1, 10'000);
+
+// Args: depth
+// Same chain held in a dag, marking walks every ancestor while roots are found once and cached
+void dag_ancestors (benchmark::State & state)
+{
+	auto depth = state.range (0);
+	uniform_validators validators{ 1 };
+	dag_t dag{ ms{ 50 } };
+	auto tip = dag.insert (0);
+	for (int64_t i = 1; i < depth; ++i)
+	{
+		tip = dag.insert (0, &tip, &tip + 1);
+	}
+	auto now = start;
+	for (auto _: state)
+	{
+		now = now + ms{ 1 };
+		benchmark::DoNotOptimize (dag.vote (tip, vote_null, validators, now));
+	}
+	state.SetItemsProcessed (state.iterations () * depth);
+}
+BENCHMARK (dag_ancestors)->ArgName ("depth")->RangeMultiplier (10)->Range (1, 10'000);
+
+// Powers of two up to the number of cores, at least up to 8 so the scaling curves of separate machines line up
+void producers (benchmark::internal::Benchmark * benchmark)
+{
+	for (unsigned i = 1, n = std::max (8u, std::thread::hardware_concurrency ()); i <= n; i *= 2)
+	{
+		benchmark->Arg (i);
+	}
+}
+
+// Args: producers
+// Producer threads insert 200k votes while the benchmark thread keeps advancing, through concurrent_agreement or a mutex around an agreement
+// per_producer is each producer's insert rate, flat across producer counts while inserts scale
+template<bool INTAKE>
+void multi_producer (benchmark::State & state)
+{
+	size_t constexpr count = 200'000;
+	auto threads = static_cast<unsigned> (state.range (0));
+	uniform_validators validators{ 1'000 };
+	for (auto _: state)
+	{
+		nano::concurrent_agreement<agreement_t> concurrent{ ms{ 50 }, 0 };
+		concurrent.get ().retain (ms{ 100 });
+		agreement_t locked{ ms{ 50 }, 0 };
+		locked.retain (ms{ 100 });
+		std::mutex mutex;
+		auto newest = start;
+		std::atomic<unsigned> running{ threads };
+		std::vector<std::thread> workers;
+		for (unsigned i = 0; i < threads; ++i)
+		{
+			workers.emplace_back ([&, i, per = count / threads] () {
+				for (size_t j = 0; j < per; ++j)
+				{
+					auto time = start + ms{ j / 100 };
+					auto validator = static_cast<unsigned> ((i * per + j) % 1'000);
+					if constexpr (INTAKE)
+					{
+						concurrent.insert (j % 3 == 0, time, validator);
+					}
+					else
+					{
+						std::lock_guard<std::mutex> lock{ mutex };
+						locked.insert (j % 3 == 0, time, validator);
+						newest = std::max (newest, time);
+					}
+				}
+				--running;
+			});
+		}
+		auto advance = [&] () {
+			if constexpr (INTAKE)
+			{
+				concurrent.advance (start + ms{ count / threads / 100 }, validators);
+			}
+			else
+			{
+				std::lock_guard<std::mutex> lock{ mutex };
+				locked.advance (newest, validators);
+			}
+		};
+		while (running != 0)
+		{
+			advance ();
+			std::this_thread::yield ();
+		}
+		advance ();
+		for (auto & worker: workers)
+		{
+			worker.join ();
+		}
+	}
+	state.SetItemsProcessed (state.iterations () * count);
+	state.counters["per_producer"] = benchmark::Counter (static_cast<double> (state.iterations () * count / threads), benchmark::Counter::kIsRate);
+}
+BENCHMARK_TEMPLATE (multi_producer, true)->ArgName ("producers")->Apply (producers)->UseRealTime ();
+BENCHMARK_TEMPLATE (multi_producer, false)->ArgName ("producers")->Apply (producers)->UseRealTime ();
+
+// Args: elections
+// Confirms every election with a quorum of votes, spread over a worker per core, starting and stopping the workers isn't timed
+void elections (benchmark::State & state)
+{
+	auto count = static_cast<uint64_t> (state.range (0));
+	uniform_validators validators{ 4 };
+	std::atomic<uint64_t> confirmed{ 0 };
+	std::optional<elections_t> manager;
+	for (auto _: state)
+	{
+		state.PauseTiming ();
+		manager.emplace (ms{ 50 }, validators, [&confirmed] (uint64_t const &, uint32_t const &, unsigned const &) { ++confirmed; }, ms{ 25 });
+		state.ResumeTiming ();
+		for (uint64_t id = 0; id < count; ++id)
+		{
+			manager->insert (id, 0);
+		}
+		for (unsigned i = 0; i < 3; ++i)
+		{
+			for (uint64_t id = 0; id < count; ++id)
+			{
+				manager->vote (id, 1, start, i);
+			}
+		}
+		manager->tick (start + ms{ 51 });
+		manager->flush ();
+		state.PauseTiming ();
+		manager.reset ();
+		state.ResumeTiming ();
+	}
+	if (confirmed != state.iterations () * count)
+	{
+		state.SkipWithError ("Elections left unconfirmed");
+	}
+	state.SetItemsProcessed (state.iterations () * count);
+}
+BENCHMARK (elections)->ArgName ("elections")->RangeMultiplier (100)->Range (1, 100'000)->UseRealTime ();
+
+// Args: elections
+// Ticks elections each holding one vote stamped an hour ahead, so none of them is due and no tick should run any of them
+void elections_tick (benchmark::State & state)
+{
+	auto count = static_cast<uint64_t> (state.range (0));
+	uniform_validators validators{ 4 };
+	elections_t manager{ ms{ 50 }, validators, [] (uint64_t const &, uint32_t const &, unsigned const &) {}, ms{ 25 } };
+	for (uint64_t id = 0; id < count; ++id)
+	{
+		manager.insert (id, 0);
+		manager.vote (id, 1, start + std::chrono::hours{ 1 }, 0);
+	}
+	// The second tick files the wake times left by the runs of the first in to the wheels
+	auto now = start;
+	for (auto i = 0; i < 2; ++i)
+	{
+		manager.tick (now += ms{ 1 });
+		manager.flush ();
+	}
+	for (auto _: state)
+	{
+		manager.tick (now += ms{ 1 });
+		manager.flush ();
+	}
+	state.SetItemsProcessed (state.iterations ());
+}
+BENCHMARK (elections_tick)->ArgName ("elections")->RangeMultiplier (100)->Range (1, 100'000)->UseRealTime ();
+
+// Votes count agreements, each holding one vote, on each millisecond for 10 W through step, reports the votes cast
+template<typename STEP>
+void vote_schedule (benchmark::State & state, STEP const & step)
+{
+	auto count = static_cast<size_t> (state.range (0));
+	uniform_validators validators{ 4 };
+	size_t votes = 0;
+	auto vote = [&votes] (uint32_t const &, time_point const &) { ++votes; };
+	for (auto _: state)
+	{
+		state.PauseTiming ();
+		std::deque<agreement_t> agreements;
+		for (size_t i = 0; i < count; ++i)
+		{
+			agreements.emplace_back (ms{ 50 }, 0);
+			agreements.back ().insert (1, start, i % 4);
+		}
+		state.ResumeTiming ();
+		step (agreements, validators, vote);
+	}
+	state.counters["votes"] = benchmark::Counter (votes, benchmark::Counter::kAvgIterations);
+}
+
+// Args: agreements
+// Every agreement votes on every millisecond, as when vote is called on each message
+void vote_every (benchmark::State & state)
+{
+	vote_schedule (state, [] (std::deque<agreement_t> & agreements, uniform_validators const & validators, auto const & vote) {
+		for (auto i = 0; i < 500; ++i)
+		{
+			for (auto & agreement: agreements)
+			{
+				agreement.vote (vote, validators, start + ms{ i });
+			}
+		}
+	});
+}
+BENCHMARK (vote_every)->ArgName ("agreements")->Arg (1'000);
+
+// Args: agreements
+// Agreements are only woken by a timer wheel one tick after the time their last vote returned
+void vote_wheel (benchmark::State & state)
+{
+	vote_schedule (state, [] (std::deque<agreement_t> & agreements, uniform_validators const & validators, auto const & vote) {
+		nano::timer_wheel<std::chrono::steady_clock, ms, agreement_t *> wheel{ start };
+		for (auto & agreement: agreements)
+		{
+			wheel.schedule (start, &agreement);
+		}
+		for (auto i = 0; i < 500; ++i)
+		{
+			auto now = start + ms{ i };
+			wheel.advance (now, [&wheel, &vote, &validators, &now] (agreement_t * item) {
+				wheel.schedule (item->vote (vote, validators, now) + ms{ 1 }, item);
+			});
+		}
+	});
+}
+BENCHMARK (vote_wheel)->ArgName ("agreements")->Arg (1'000);
+
+// Temporary file removed when the benchmark finishes
+class temporary
+{
+public:
+	temporary (char const * name) :
+	path{ std::filesystem::temp_directory_path () / name }
+	{
+		std::filesystem::remove (path);
+	}
+	~temporary ()
+	{
+		std::filesystem::remove (path);
+	}
+	std::filesystem::path path;
+};
+
+// Args: votes
+// Inserts votes written through to a journal, syncing it after the last
+void journal_insert (benchmark::State & state)
+{
+	using journal_t = nano::journal<agreement_t>;
+	auto count = static_cast<size_t> (state.range (0));
+	temporary file{ "bench_journal_insert" };
+	for (auto _: state)
+	{
+		std::filesystem::remove (file.path);
+		journal_t journal{ file.path };
+		agreement_t item{ ms{ 50 }, 0 };
+		journal.attach (item);
+		for (size_t i = 0; i < count; ++i)
+		{
+			item.insert (i % 3, start + ms{ i / 100 }, i % 100);
+		}
+		journal.sync ();
+	}
+	state.SetItemsProcessed (state.iterations () * count);
+	state.SetBytesProcessed (state.iterations () * count * journal_t::record_bytes);
+}
+BENCHMARK (journal_insert)->ArgName ("votes")->Arg (1'000'000)->Unit (benchmark::kMillisecond);
+
+// Args: votes
+// Rebuilds an agreement from a journal of votes
+void journal_restore (benchmark::State & state)
+{
+	using journal_t = nano::journal<agreement_t>;
+	auto count = static_cast<size_t> (state.range (0));
+	temporary file{ "bench_journal_restore" };
+	{
+		journal_t journal{ file.path };
+		agreement_t item{ ms{ 50 }, 0 };
+		journal.attach (item);
+		for (size_t i = 0; i < count; ++i)
+		{
+			item.insert (i % 3, start + ms{ i / 100 }, i % 100);
+		}
+		journal.sync ();
+	}
+	for (auto _: state)
+	{
+		journal_t journal{ file.path };
+		agreement_t item{ ms{ 50 }, 0 };
+		benchmark::DoNotOptimize (journal.restore (item));
+	}
+	state.SetItemsProcessed (state.iterations () * count);
+}
+BENCHMARK (journal_restore)->ArgName ("votes")->Arg (1'000'000)->Unit (benchmark::kMillisecond);
+
+// Elections of a hundred votes each
+std::vector<std::shared_ptr<agreement_t>> checkpoint (size_t count)
+{
+	std::vector<std::shared_ptr<agreement_t>> result;
+	for (size_t i = 0; i < count; ++i)
+	{
+		result.push_back (std::make_shared<agreement_t> (ms{ 50 }, 0));
+		for (unsigned j = 0; j < 100; ++j)
+		{
+			result.back ()->insert (j % 3, start + ms{ j }, j);
+		}
+	}
+	return result;
+}
+
+// Args: elections
+// Saves a snapshot of elections holding a hundred votes each
+void snapshot_save (benchmark::State & state)
+{
+	auto elections = checkpoint (static_cast<size_t> (state.range (0)));
+	temporary file{ "bench_snapshot_save" };
+	for (auto _: state)
+	{
+		benchmark::DoNotOptimize (nano::snapshot<agreement_t>::save (elections.begin (), elections.end (), file.path));
+	}
+	state.SetItemsProcessed (state.iterations () * elections.size ());
+	state.SetBytesProcessed (state.iterations () * std::filesystem::file_size (file.path));
+}
+BENCHMARK (snapshot_save)->ArgName ("elections")->Arg (10'000)->Unit (benchmark::kMillisecond);
+
+// Args: elections
+// Restores the snapshot written by snapshot_save
+void snapshot_restore (benchmark::State & state)
+{
+	auto elections = checkpoint (static_cast<size_t> (state.range (0)));
+	temporary file{ "bench_snapshot_restore" };
+	nano::snapshot<agreement_t>::save (elections.begin (), elections.end (), file.path);
+	for (auto _: state)
+	{
+		benchmark::DoNotOptimize (nano::snapshot<agreement_t>::restore (file.path));
+	}
+	state.SetItemsProcessed (state.iterations () * elections.size ());
+}
+BENCHMARK (snapshot_restore)->ArgName ("elections")->Arg (10'000)->Unit (benchmark::kMillisecond);
+
+// Args: elections
+// Restores the same snapshot from a buffer already in memory, leaving out mapping and faulting in the file
+void snapshot_decode (benchmark::State & state)
+{
+	auto elections = checkpoint (static_cast<size_t> (state.range (0)));
+	auto out = nano::snapshot<agreement_t>::save (elections.begin (), elections.end ());
+	for (auto _: state)
+	{
+		benchmark::DoNotOptimize (nano::snapshot<agreement_t>::restore (nano::serial::reader{ out.buffer ().data (), out.buffer ().size () }));
+	}
+	state.SetItemsProcessed (state.iterations () * elections.size ());
+}
+BENCHMARK (snapshot_decode)->ArgName ("elections")->Arg (10'000)->Unit (benchmark::kMillisecond);
+
+// Args: elections
+// Rebuilds the same elections by inserting every vote again, the alternative to restoring a snapshot
+void snapshot_replay (benchmark::State & state)
+{
+	auto count = static_cast<size_t> (state.range (0));
+	for (auto _: state)
+	{
+		benchmark::DoNotOptimize (checkpoint (count));
+	}
+	state.SetItemsProcessed (state.iterations () * count);
+}
+BENCHMARK (snapshot_replay)->ArgName ("elections")->Arg (10'000)->Unit (benchmark::kMillisecond);
+
+// Agreement holding 200k votes for 5 objects from 100 validators
+std::unique_ptr<agreement_t> exported ()
+{
+	auto result = std::make_unique<agreement_t> (ms{ 50 }, 0);
+	std::mt19937_64 random{ 0 };
+	std::uniform_int_distribution<unsigned> validator{ 0, 99 };
+	std::uniform_int_distribution<uint32_t> value{ 0, 4 };
+	for (size_t i = 0; i < 200'000; ++i)
+	{
+		result->insert (value (random), start + ms{ i / 10 }, validator (random));
+	}
+	return result;
+}
+
+// Writes every edge of a scan as CSV text, one row per object at each edge
+void export_csv (benchmark::State & state)
+{
+	uniform_validators validators{ 100 };
+	auto item = exported ();
+	temporary file{ "bench_export.csv" };
+	for (auto _: state)
+	{
+		class agreement_t::tally tally;
+		std::ofstream out{ file.path, std::ios::out | std::ios::trunc };
+		item->scan (tally, time_point::min (), time_point::max (), validators, [&out] (time_point const & time, class agreement_t::tally const & tally) {
+			for (auto const & [object, weight]: tally.totals ())
+			{
+				out << std::to_string (time.time_since_epoch ().count ()) << ',' << std::to_string (object) << ',' << std::to_string (weight) << '\n';
+			}
+		});
+	}
+	state.SetBytesProcessed (state.iterations () * std::filesystem::file_size (file.path));
+}
+BENCHMARK (export_csv)->Unit (benchmark::kMillisecond);
+
+// Writes the same edges in the binary edge format
+void export_binary (benchmark::State & state)
+{
+	uniform_validators validators{ 100 };
+	auto item = exported ();
+	temporary file{ "bench_export.bin" };
+	for (auto _: state)
+	{
+		benchmark::DoNotOptimize (nano::export_edges (*item, validators, file.path));
+	}
+	state.SetBytesProcessed (state.iterations () * std::filesystem::file_size (file.path));
+}
+BENCHMARK (export_binary)->Unit (benchmark::kMillisecond);
+
+// Reads the binary edges back in to columns
+void export_read (benchmark::State & state)
+{
+	uniform_validators validators{ 100 };
+	auto item = exported ();
+	temporary file{ "bench_export_read.bin" };
+	nano::export_edges (*item, validators, file.path);
+	nano::edge_reader<agreement_t> reader;
+	for (auto _: state)
+	{
+		benchmark::DoNotOptimize (reader.read (file.path));
+	}
+	state.SetItemsProcessed (state.iterations () * reader.times.size ());
+}
+BENCHMARK (export_read)->Unit (benchmark::kMillisecond);
+
+using simulator_t = nano::simulator<nano::agreement<bool, uniform_validators, nano::simulated_clock>>;
+
+// Args: rounds
+// Soak of consecutive simulator seeds with four validators, one faulty, failing if any round stalled or confirmed conflicting values
+void simulate (benchmark::State & state)
+{
+	auto rounds = static_cast<uint64_t> (state.range (0));
+	uniform_validators validators{ 4 };
+	simulator_t::parameters params;
+	params.W = ms{ 50 };
+	params.hold = 2 * params.W + ms{ 1 };
+	params.faulty = 1;
+	params.choices = { false, true };
+	simulator_t simulator{ validators, { 0, 1, 2, 3 }, params };
+	uint64_t failures = 0;
+	uint64_t seed = 0;
+	for (auto _: state)
+	{
+		for (uint64_t i = 0; i < rounds; ++i, ++seed)
+		{
+			auto const & result = simulator.run (seed);
+			failures += !result.live || result.confirmed != 1;
+		}
+	}
+	if (failures != 0)
+	{
+		state.SkipWithError ("Rounds stalled or confirmed conflicting values");
+	}
+	state.SetItemsProcessed (state.iterations () * rounds);
+}
+BENCHMARK (simulate)->ArgName ("rounds")->Arg (100'000)->Unit (benchmark::kMillisecond);
+}
+
+// Reports as JSON unless another format is asked for so runs can be stored and compared, e.g. with compare.py from Google Benchmark
+int main (int argc, char ** argv)
+{
+	std::string json{ "--benchmark_format=json" };
+	std::vector<char *> args{ argv[0], json.data () };
+	args.insert (args.end (), argv + 1, argv + argc);
+	auto count = static_cast<int> (args.size ());
+	benchmark::Initialize (&count, args.data ());
+	if (benchmark::ReportUnrecognizedArguments (count, args.data ()))
+	{
+		return 1;
+	}
+	benchmark::RunSpecifiedBenchmarks ();
+	benchmark::Shutdown ();
+	return 0;
+}
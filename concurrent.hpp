@@ -0,0 +1,122 @@
+#pragma once
+
+#include "agreement.hpp"
+
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+namespace nano
+{
+// Many producers, one consumer queue of ENTRY
+// Producers hold the lock only to append one entry, the consumer swaps the whole buffer out and handles it unlocked
+template <typename ENTRY>
+class intake
+{
+public:
+	using entry = ENTRY;
+private:
+	std::mutex mutex;
+	std::vector<entry> pending;
+	// Buffer handed back to producers after each take so neither side allocates once both have grown
+	std::vector<entry> taken;
+public:
+	// Safe to call from any thread concurrently with every other member
+	void push (entry && item)
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		pending.push_back (std::move (item));
+	}
+	// Called only from the consumer thread
+	// Moves every entry pushed so far in to f, each producer's entries in the order it pushed them
+	template<typename UnaryFunction>
+	size_t take (UnaryFunction const & f)
+	{
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			pending.swap (taken);
+		}
+		for (auto & item: taken)
+		{
+			f (std::move (item));
+		}
+		auto result = taken.size ();
+		taken.clear ();
+		return result;
+	}
+};
+// Agreement accepting votes from any number of threads
+// insert appends to an intake, the single tallying thread drains it before every tally, advance or vote
+// so those see a consistent snapshot of every vote whose insert completed beforehand
+template <typename AGREEMENT>
+class concurrent_agreement
+{
+public:
+	using agreement = AGREEMENT;
+	using object = typename agreement::object;
+	using validators = typename agreement::validators;
+	using duration = typename agreement::duration;
+	using time_point = typename agreement::time_point;
+	using validator = typename agreement::validator;
+private:
+	using entry = std::tuple<object, time_point, validator>;
+	agreement value;
+	intake<entry> incoming;
+	// Drained votes in (object, time, validator) form as taken by agreement::insert_batch, reused between drains
+	std::vector<entry> drained;
+	// Takes every vote published so far, each producer's votes in the order it inserted them
+	void take ()
+	{
+		drained.clear ();
+		incoming.take ([this] (entry && item) { drained.push_back (std::move (item)); });
+	}
+	void drain ()
+	{
+		take ();
+		for (auto const & [item, time, from]: drained)
+		{
+			value.insert (item, time, from);
+		}
+	}
+public:
+	concurrent_agreement (duration const & window, object const & item) :
+	value{ window, item }
+	{
+	}
+	// Safe to call from any thread concurrently with every other member
+	void insert (object const & item, time_point const & time, validator const & from)
+	{
+		incoming.push (entry{ item, time, from });
+	}
+	// Members below are called only from the tallying thread
+	template<typename CONFIRM = decltype(agreement::confirm_null), typename FAULT = decltype(agreement::fault_null)>
+	void tally (time_point const & begin, time_point const & end, validators const & validators, CONFIRM const & confirm = agreement::confirm_null, FAULT const & fault = agreement::fault_null, duration const & hold = duration{})
+	{
+		drain ();
+		value.tally (begin, end, validators, confirm, fault, hold);
+	}
+	// Merges drained votes as one batch and advances the live window once to now, votes stamped after now don't move it further
+	template<typename CONFIRM = decltype(agreement::confirm_null), typename FAULT = decltype(agreement::fault_null)>
+	void advance (time_point const & now, validators const & validators, CONFIRM const & confirm = agreement::confirm_null, FAULT const & fault = agreement::fault_null, duration const & hold = duration{})
+	{
+		take ();
+		value.insert_batch (drained.begin (), drained.end (), now, validators, confirm, fault, hold);
+	}
+	template<typename VoteFunction, typename FAULT = decltype(agreement::fault_null)>
+	time_point vote (VoteFunction const & vote, validators const & validators, time_point const & now, FAULT const & fault = agreement::fault_null)
+	{
+		drain ();
+		return value.vote (vote, validators, now, fault);
+	}
+	void reset (object const & item)
+	{
+		drain ();
+		value.reset (item);
+	}
+	// Underlying agreement, votes still in the intake are not visible through it
+	agreement & get ()
+	{
+		return value;
+	}
+};
+}
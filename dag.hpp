@@ -0,0 +1,328 @@
+#pragma once
+
+#include "agreement.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace nano
+{
+// Graph of agreements owned in per-generation arena blocks, an alternative to holding each node in a shared_ptr
+// Parent edges are compact handles and a generation's block is released in one step once every node in it has confirmed
+// Nodes inserted here have no parents of their own, ancestry is tracked by the container and passed to agreement::vote
+// Each node's reach and cached roots are kept in its core's own fields for them, its walk stamp in node::visited
+template <typename AGREEMENT>
+class dag
+{
+public:
+	// Nodes hold the core of AGREEMENT since their parents are this container's edges
+	using agreement = typename AGREEMENT::core;
+	using object = typename agreement::object;
+	using validators = typename agreement::validators;
+	using duration = typename agreement::duration;
+	using time_point = typename agreement::time_point;
+	using weight = typename agreement::weight;
+	using stats = typename agreement::stats;
+	class handle
+	{
+	public:
+		uint32_t generation;
+		uint32_t index;
+		bool operator== (handle const & other) const
+		{
+			return generation == other.generation && index == other.index;
+		}
+	};
+private:
+	class node
+	{
+	public:
+		node (duration const & window, object const & item, uint32_t first, uint32_t count) :
+		value{ window, item },
+		first{ first },
+		count{ count }
+		{
+		}
+		agreement value;
+		// Range of this node's parents in its block's edges, a confirmed node drops its parents and has first set to confirmed
+		uint32_t first;
+		uint32_t count;
+		// Stamp of the last ancestor walk that reached this node, walks over a dag are serialised by its owner
+		uint64_t visited{ 0 };
+		static uint32_t constexpr confirmed = std::numeric_limits<uint32_t>::max ();
+	};
+	class block
+	{
+	public:
+		// Nodes are held in chunks reserved up front so they never move and each chunk is one allocation
+		static size_t constexpr chunk = 64;
+		std::vector<std::vector<node>> nodes;
+		std::vector<handle> edges;
+		size_t size{ 0 };
+		size_t pending{ 0 };
+		bool released{ false };
+		node & operator[] (size_t index)
+		{
+			return nodes[index / chunk][index % chunk];
+		}
+		void emplace (duration const & window, object const & item, uint32_t first, uint32_t count)
+		{
+			if (size % chunk == 0)
+			{
+				nodes.emplace_back ();
+				nodes.back ().reserve (chunk);
+			}
+			nodes.back ().emplace_back (window, item, first, count);
+			++size;
+		}
+	};
+	duration W;
+	// Generation of blocks.front ()
+	uint32_t base{ 0 };
+	std::deque<block> blocks;
+	uint64_t visit{ 0 };
+	size_t size_m{ 0 };
+	node & at (handle const & item)
+	{
+		assert (live (item));
+		return blocks[item.generation - base][item.index];
+	}
+	block & owner (handle const & item)
+	{
+		return blocks[item.generation - base];
+	}
+	// True if none of item's parents are live, so marks stop rising at it
+	bool root (handle const & item)
+	{
+		auto const & node = at (item);
+		auto const & edges = owner (item).edges;
+		for (auto i = node.first, n = node.first + node.count; i < n; ++i)
+		{
+			if (live (edges[i]))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	// Visits every live ancestor of item once, not including item itself
+	// The walk does not continue past an ancestor for which f (handle, node) returns false
+	template<typename BinaryFunction>
+	void for_each_ancestor (handle const & item, BinaryFunction f)
+	{
+		typename stats::timer timer{ measure::walk };
+		uint64_t length = 0;
+		auto current = ++visit;
+		std::vector<handle> work{ item };
+		while (!work.empty ())
+		{
+			auto top = work.back ();
+			work.pop_back ();
+			auto & node = at (top);
+			auto & edges = owner (top).edges;
+			for (auto i = node.first, n = node.first + node.count; i < n; ++i)
+			{
+				auto const & parent = edges[i];
+				if (live (parent))
+				{
+					auto & value = at (parent);
+					if (value.visited != current)
+					{
+						value.visited = current;
+						++length;
+						if (f (parent, value))
+						{
+							work.push_back (parent);
+						}
+					}
+				}
+			}
+		}
+		stats::count (counter::ancestors, length);
+		stats::observe (measure::walk_length, length);
+	}
+	// Moves the lineage of every root above item before its parents are dropped, descendants caching those roots rebuild on their next vote
+	void detach (handle const & item)
+	{
+		for_each_ancestor (item, [this] (handle const & parent, class node & value) {
+			if (value.value.lineage && root (parent))
+			{
+				++*value.value.lineage;
+			}
+			return true;
+		});
+		auto & value = at (item).value;
+		value.roots.clear ();
+		value.roots_valid = false;
+	}
+	// Releases blocks of past generations whose nodes have all confirmed, the current generation is never released
+	void collect ()
+	{
+		for (size_t i = 0, n = blocks.size () - 1; i < n; ++i)
+		{
+			auto & block = blocks[i];
+			if (!block.released && block.pending == 0)
+			{
+				// Every node here confirmed so is a root, descendants may have cached it
+				for (auto & chunk: block.nodes)
+				{
+					for (auto & node: chunk)
+					{
+						if (node.value.lineage)
+						{
+							++*node.value.lineage;
+						}
+					}
+				}
+				size_m -= block.size;
+				block.nodes = std::vector<std::vector<node>>{};
+				block.edges = std::vector<handle>{};
+				block.released = true;
+			}
+		}
+		while (blocks.size () > 1 && blocks.front ().released)
+		{
+			blocks.pop_front ();
+			++base;
+		}
+	}
+	template<typename CONFIRM>
+	auto confirmer (handle const & item, CONFIRM const & confirm)
+	{
+		return [this, item, &confirm] (object const & value, weight const & total) {
+			auto & node = at (item);
+			if (node.first != node::confirmed)
+			{
+				detach (item);
+				node.first = node::confirmed;
+				node.count = 0;
+				--owner (item).pending;
+			}
+			confirm (value, total);
+		};
+	}
+public:
+	dag (duration const & window) :
+	W{ window },
+	blocks (1)
+	{
+	}
+	handle insert (object const & item)
+	{
+		return insert (item, static_cast<handle const *> (nullptr), static_cast<handle const *> (nullptr));
+	}
+	// Inserts a node in to the current generation with parents given as handles
+	template<typename ParentIt>
+	handle insert (object const & item, ParentIt first, ParentIt last)
+	{
+		auto & block = blocks.back ();
+		auto begin = static_cast<uint32_t> (block.edges.size ());
+		block.edges.insert (block.edges.end (), first, last);
+		block.emplace (W, item, begin, static_cast<uint32_t> (block.edges.size () - begin));
+		++block.pending;
+		++size_m;
+		return handle{ static_cast<uint32_t> (base + blocks.size () - 1), static_cast<uint32_t> (block.size - 1) };
+	}
+	// Starts a new generation, subsequent inserts go in to a new block and past generations become eligible for release
+	void next ()
+	{
+		blocks.emplace_back ();
+		collect ();
+	}
+	// Returns true if item has not been released along with its generation
+	bool live (handle const & item) const
+	{
+		return item.generation >= base && item.generation - base < blocks.size () && !blocks[item.generation - base].released;
+	}
+	bool confirmed (handle const & item)
+	{
+		return at (item).first == node::confirmed;
+	}
+	agreement & operator[] (handle const & item)
+	{
+		return at (item).value;
+	}
+	template<typename CONFIRM = decltype(agreement::confirm_null), typename FAULT = decltype(agreement::fault_null)>
+	void tally (handle const & item, time_point const & begin, time_point const & end, validators const & validators, CONFIRM const & confirm = agreement::confirm_null, FAULT const & fault = agreement::fault_null, duration const & hold = duration{})
+	{
+		at (item).value.tally (begin, end, validators, confirmer (item, confirm), fault, hold);
+		collect ();
+	}
+	template<typename CONFIRM = decltype(agreement::confirm_null), typename FAULT = decltype(agreement::fault_null)>
+	void advance (handle const & item, time_point const & now, validators const & validators, CONFIRM const & confirm = agreement::confirm_null, FAULT const & fault = agreement::fault_null, duration const & hold = duration{})
+	{
+		at (item).value.advance (now, validators, confirmer (item, confirm), fault, hold);
+		collect ();
+	}
+	// Same decision as agreement::vote with ancestry taken from this container's edges
+	template<typename VoteFunction, typename FAULT = decltype(agreement::fault_null)>
+	time_point vote (handle const & item, VoteFunction const & vote, validators const & validators, time_point const & now, FAULT const & fault = agreement::fault_null)
+	{
+		auto & value = at (item).value;
+		// The node's own time and reach are checked by agreement::vote, marking raises every ancestor up to the roots so only they and the floor left by reset roots need checking
+		auto replaceable = [this, &item, &value] () {
+			auto valid = value.roots_valid && std::all_of (value.roots.begin (), value.roots.end (), [] (auto const & root) { return *root.lineage == root.seen; });
+			if (!valid)
+			{
+				value.roots.clear ();
+				value.floor = time_point{};
+				for_each_ancestor (item, [this, &value] (handle const & parent, class node & ancestor) {
+					if (root (parent))
+					{
+						auto & lineage = ancestor.value.lineage;
+						if (!lineage)
+						{
+							lineage = std::make_shared<uint64_t> (0);
+						}
+						value.roots.push_back ({ &ancestor.value, lineage, *lineage });
+					}
+					else
+					{
+						value.floor = std::max (value.floor, std::max (ancestor.value.time, ancestor.value.reach));
+					}
+					return true;
+				});
+				value.roots_valid = true;
+			}
+			auto result = value.floor + W;
+			for (auto const & root: value.roots)
+			{
+				result = std::max (result, std::max (root.item->time, root.item->reach) + W);
+			}
+			return result;
+		};
+		auto mark = [this, &item] (time_point const & now) {
+			auto current = agreement::resets.load (std::memory_order_relaxed);
+			for_each_ancestor (item, [&now, current] (handle const &, class node & ancestor) {
+				auto result = ancestor.value.reach < now || ancestor.value.epoch != current;
+				if (result)
+				{
+					ancestor.value.reach = now;
+					ancestor.value.epoch = current;
+				}
+				return result;
+			});
+		};
+		return value.vote (vote, validators, now, replaceable, mark, fault);
+	}
+	// Number of nodes not yet released
+	size_t size () const
+	{
+		return size_m;
+	}
+	// Bytes held by nodes and edges of generations not yet released, excluding each agreement's vote storage
+	size_t bytes () const
+	{
+		size_t result = 0;
+		for (auto const & block: blocks)
+		{
+			result += block.nodes.size () * block::chunk * sizeof (node) + block.edges.capacity () * sizeof (handle);
+		}
+		return result;
+	}
+};
+}
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+namespace nano
+{
+// Binary columnar export of the (time, object, weight) rows a scan produces, one row per object in the tally at every edge
+// The file starts with a 16 byte header: magic "nanoedge", u16 version, the type tag and byte size of objects then weights and u8 flags
+// Rows follow in blocks: u32 rows, u8 time width, 3 padding bytes, i64 base then the time, object and weight columns in turn
+// Times are ticks since the clock's epoch, a width of 0 stores them as raw i64, otherwise as unsigned deltas of that many bytes from the previous row with the first row at base
+// Type tags are 'b' bool, 'i' signed, 'u' unsigned and 'f' floating point, values are in host byte order
+namespace edges
+{
+static char constexpr magic[8] = { 'n', 'a', 'n', 'o', 'e', 'd', 'g', 'e' };
+static uint16_t constexpr version = 1;
+// Times may be written as deltas from the previous row
+static uint8_t constexpr delta = 1;
+template<typename T>
+char constexpr tag ()
+{
+	static_assert (std::is_arithmetic<T>::value, "Exported objects and weights must be arithmetic");
+	return std::is_same<T, bool>::value ? 'b' : std::is_floating_point<T>::value ? 'f' : std::is_signed<T>::value ? 'i' : 'u';
+}
+// Contiguous column of T, bools are held as bytes since std::vector<bool> has no contiguous storage
+template<typename T>
+using column = std::vector<std::conditional_t<std::is_same<T, bool>::value, uint8_t, T>>;
+}
+// Buffers rows and writes them a block at a time, usable directly as the edge function passed to agreement::scan
+template <typename AGREEMENT>
+class edge_writer
+{
+public:
+	using agreement = AGREEMENT;
+	using object = typename agreement::object;
+	using weight = typename agreement::weight;
+	using time_point = typename agreement::time_point;
+private:
+	std::ofstream stream;
+	uint8_t flags;
+	size_t capacity;
+	std::vector<int64_t> times;
+	edges::column<object> objects;
+	edges::column<weight> weights;
+	std::vector<uint8_t> block;
+	template<typename T>
+	void append (T const * data, size_t count)
+	{
+		auto offset = block.size ();
+		block.resize (offset + count * sizeof (T));
+		std::memcpy (block.data () + offset, data, count * sizeof (T));
+	}
+	// Narrowest width holding every delta, 0 if times ever run backwards
+	uint8_t width () const
+	{
+		if (!(flags & edges::delta))
+		{
+			return 0;
+		}
+		uint64_t largest = 0;
+		for (size_t i = 1; i < times.size (); ++i)
+		{
+			if (times[i] < times[i - 1])
+			{
+				return 0;
+			}
+			largest = std::max (largest, static_cast<uint64_t> (times[i] - times[i - 1]));
+		}
+		return largest <= UINT8_MAX ? 1 : largest <= UINT16_MAX ? 2 : largest <= UINT32_MAX ? 4 : 8;
+	}
+	template<typename T>
+	void deltas ()
+	{
+		std::vector<T> column (times.size ());
+		for (size_t i = 1; i < times.size (); ++i)
+		{
+			column[i] = static_cast<T> (times[i] - times[i - 1]);
+		}
+		append (column.data (), column.size ());
+	}
+public:
+	// Rows are buffered until rows of them are waiting
+	edge_writer (std::filesystem::path const & path, bool delta = true, size_t rows = 64 * 1024) :
+	stream{ path, std::ios::binary | std::ios::trunc },
+	flags{ delta ? edges::delta : uint8_t{ 0 } },
+	capacity{ rows }
+	{
+		times.reserve (capacity);
+		objects.reserve (capacity);
+		weights.reserve (capacity);
+		uint8_t header[16] = {};
+		std::memcpy (header, edges::magic, sizeof (edges::magic));
+		std::memcpy (header + 8, &edges::version, sizeof (edges::version));
+		header[10] = edges::tag<object> ();
+		header[11] = sizeof (object);
+		header[12] = edges::tag<weight> ();
+		header[13] = sizeof (weight);
+		header[14] = flags;
+		stream.write (reinterpret_cast<char const *> (header), sizeof (header));
+	}
+	edge_writer (edge_writer const &) = delete;
+	~edge_writer ()
+	{
+		flush ();
+	}
+	void operator() (time_point const & time, typename agreement::tally const & tally)
+	{
+		auto ticks = static_cast<int64_t> (time.time_since_epoch ().count ());
+		for (auto const & [item, total]: tally.totals ())
+		{
+			times.push_back (ticks);
+			objects.push_back (item);
+			weights.push_back (total);
+		}
+		if (times.size () >= capacity)
+		{
+			flush ();
+		}
+	}
+	// Writes buffered rows as one block
+	void flush ()
+	{
+		if (times.empty ())
+		{
+			return;
+		}
+		block.clear ();
+		uint32_t rows = static_cast<uint32_t> (times.size ());
+		auto bytes = width ();
+		int64_t base = bytes == 0 ? 0 : times.front ();
+		append (&rows, 1);
+		uint8_t layout[4] = { bytes };
+		append (layout, sizeof (layout));
+		append (&base, 1);
+		switch (bytes)
+		{
+			case 1:
+				deltas<uint8_t> ();
+				break;
+			case 2:
+				deltas<uint16_t> ();
+				break;
+			case 4:
+				deltas<uint32_t> ();
+				break;
+			case 8:
+				deltas<uint64_t> ();
+				break;
+			default:
+				append (times.data (), times.size ());
+				break;
+		}
+		append (objects.data (), objects.size ());
+		append (weights.data (), weights.size ());
+		stream.write (reinterpret_cast<char const *> (block.data ()), block.size ());
+		times.clear ();
+		objects.clear ();
+		weights.clear ();
+	}
+	// False once a write has failed
+	bool good () const
+	{
+		return static_cast<bool> (stream);
+	}
+};
+// Loads a file written by edge_writer in to whole columns
+template <typename AGREEMENT>
+class edge_reader
+{
+public:
+	using agreement = AGREEMENT;
+	using object = typename agreement::object;
+	using weight = typename agreement::weight;
+	std::vector<int64_t> times;
+	edges::column<object> objects;
+	edges::column<weight> weights;
+private:
+	template<typename T>
+	static bool take (uint8_t const *& position, uint8_t const * end, T * data, size_t count)
+	{
+		if (static_cast<size_t> (end - position) < count * sizeof (T))
+		{
+			return false;
+		}
+		std::memcpy (data, position, count * sizeof (T));
+		position += count * sizeof (T);
+		return true;
+	}
+	template<typename T>
+	bool undelta (uint8_t const *& position, uint8_t const * end, size_t offset, size_t rows, int64_t base)
+	{
+		std::vector<T> column (rows);
+		if (!take (position, end, column.data (), rows))
+		{
+			return false;
+		}
+		for (size_t i = 0; i < rows; ++i)
+		{
+			base += static_cast<int64_t> (column[i]);
+			times[offset + i] = base;
+		}
+		return true;
+	}
+public:
+	// Replaces the columns with the rows in path, returns false if it can't be read or doesn't hold this agreement's object and weight types
+	bool read (std::filesystem::path const & path)
+	{
+		times.clear ();
+		objects.clear ();
+		weights.clear ();
+		std::ifstream stream{ path, std::ios::binary };
+		std::vector<uint8_t> buffer{ std::istreambuf_iterator<char> (stream), std::istreambuf_iterator<char> () };
+		uint8_t const * position = buffer.data ();
+		uint8_t const * end = position + buffer.size ();
+		uint8_t header[16];
+		if (!take (position, end, header, sizeof (header)) || std::memcmp (header, edges::magic, sizeof (edges::magic)) != 0)
+		{
+			return false;
+		}
+		uint16_t found;
+		std::memcpy (&found, header + 8, sizeof (found));
+		if (found != edges::version || header[10] != edges::tag<object> () || header[11] != sizeof (object) || header[12] != edges::tag<weight> () || header[13] != sizeof (weight))
+		{
+			return false;
+		}
+		while (position != end)
+		{
+			uint32_t rows;
+			uint8_t layout[4];
+			int64_t base;
+			if (!take (position, end, &rows, 1) || !take (position, end, layout, sizeof (layout)) || !take (position, end, &base, 1) || rows > static_cast<size_t> (end - position) / (sizeof (object) + sizeof (weight)))
+			{
+				return false;
+			}
+			auto offset = times.size ();
+			times.resize (offset + rows);
+			objects.resize (offset + rows);
+			weights.resize (offset + rows);
+			auto result = false;
+			switch (layout[0])
+			{
+				case 0:
+					result = take (position, end, times.data () + offset, rows);
+					break;
+				case 1:
+					result = undelta<uint8_t> (position, end, offset, rows, base);
+					break;
+				case 2:
+					result = undelta<uint16_t> (position, end, offset, rows, base);
+					break;
+				case 4:
+					result = undelta<uint32_t> (position, end, offset, rows, base);
+					break;
+				case 8:
+					result = undelta<uint64_t> (position, end, offset, rows, base);
+					break;
+			}
+			if (!result || !take (position, end, objects.data () + offset, rows) || !take (position, end, weights.data () + offset, rows))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+};
+// Scans agreement over [begin, end] writing every edge to path, votes at end are included as in scan
+template<typename AGREEMENT>
+bool export_edges (AGREEMENT & agreement, typename AGREEMENT::validators const & validators, std::filesystem::path const & path, typename AGREEMENT::time_point begin = typename AGREEMENT::time_point{}, typename AGREEMENT::time_point end = AGREEMENT::time_point::max (), bool delta = true)
+{
+	class AGREEMENT::tally tally;
+	edge_writer<AGREEMENT> writer{ path, delta };
+	agreement.scan (tally, begin, end, validators, std::ref (writer));
+	writer.flush ();
+	return writer.good ();
+}
+}
@@ -0,0 +1,489 @@
+#pragma once
+
+#include "concurrent.hpp"
+#include "histogram.hpp"
+#include "timer_wheel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace nano
+{
+// Runs many independent agreements, one per election key, across a pool of worker threads
+// Elections are sharded by key so lookups only lock one shard, votes go through an intake on the election's home worker
+// The home worker hands each vote to its election and queues it, idle workers steal queued elections from the others
+// Between votes an election only runs again once time reaches the next edge of its live window, kept in its home worker's timer wheel
+// With a voter set each election also runs to vote one tick after the time its previous vote returned, instead of on every message
+template <typename AGREEMENT, typename KEY>
+class elections
+{
+public:
+	using agreement = AGREEMENT;
+	using key = KEY;
+	using object = typename agreement::object;
+	using validators = typename agreement::validators;
+	using duration = typename agreement::duration;
+	using time_point = typename agreement::time_point;
+	using validator = typename agreement::validator;
+	using weight = typename agreement::weight;
+	using confirm_function = std::function<void(key const &, object const &, weight const &)>;
+	using fault_function = std::function<void(key const &, validator const &)>;
+	using vote_function = std::function<void(key const &, object const &, time_point const &)>;
+private:
+	enum class status : uint8_t
+	{
+		idle,
+		queued,
+		running,
+		// New votes arrived while running, the running worker goes round again
+		rerun
+	};
+	using entry = std::tuple<object, time_point, validator>;
+	class election
+	{
+	public:
+		election (duration const & window, key const & id, object const & item) :
+		value{ window, item },
+		id{ id }
+		{
+		}
+		// Only touched by the worker running the election
+		agreement value;
+		key const id;
+		// Earliest time the voter is next called for this election
+		time_point next{ time_point{} };
+		std::atomic<status> state{ status::idle };
+		std::atomic<bool> confirmed{ false };
+		// Time the election next needs to run without new votes as of its last run, time_point::max () if never
+		std::atomic<time_point> wake{ time_point::max () };
+		// Votes handed over by the home worker since the last run, guarded by mutex
+		std::mutex mutex;
+		std::vector<entry> pending;
+	};
+	// Vote waiting in a worker's intake for the election it's routed to
+	class ballot
+	{
+	public:
+		std::shared_ptr<election> target;
+		object item;
+		time_point time;
+		validator from;
+	};
+	class shard
+	{
+	public:
+		std::mutex mutex;
+		std::unordered_map<key, std::shared_ptr<election>> items;
+	};
+	class worker
+	{
+	public:
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::deque<std::shared_ptr<election>> queue;
+		// Waiting on condition for work, guarded by mutex
+		bool sleeping{ false };
+		std::thread thread;
+		// Votes for the elections homed on this worker, from any number of threads
+		intake<ballot> incoming;
+		// Set when incoming or rounds may have something new, cleared by the worker before it takes them
+		std::atomic<bool> notified{ false };
+		// Flushes waiting for this worker to hand over every vote in its intake
+		std::atomic<size_t> rounds{ 0 };
+		// Time elections homed here run at, only moved to the latest tick once every vote routed before it has been handed over
+		std::atomic<time_point> now{ time_point{} };
+		// Wake times of elections homed here, only touched by this worker
+		timer_wheel<typename agreement::clock, duration, std::weak_ptr<election>> wheel{ time_point{} };
+		// Wake times set by runs on any worker waiting to be put in wheel, guarded by mutex
+		std::vector<std::pair<time_point, std::weak_ptr<election>>> timers;
+	};
+	duration W;
+	validators const & validators_m;
+	confirm_function confirm;
+	// Width quorum has to be held for before an election confirms
+	duration hold;
+	fault_function fault;
+	vote_function voter;
+	std::vector<shard> shards;
+	std::vector<worker> workers;
+	// Latest time passed to tick
+	std::atomic<time_point> now_m;
+	std::atomic<bool> stopped{ false };
+	// Elections queued or running plus rounds not yet taken by their worker, flush waits for this to reach zero
+	std::atomic<size_t> outstanding{ 0 };
+	// Elections waiting in any worker's queue and workers waiting for one, a worker only sleeps while nothing is queued
+	std::atomic<size_t> queued{ 0 };
+	std::atomic<size_t> sleepers{ 0 };
+	std::mutex idle_mutex;
+	std::condition_variable idle;
+	// Durations from each confirmed election's first vote to quorum and to confirmation
+	histogram<> quorum_m;
+	histogram<> confirmation_m;
+	static uint64_t ticks (time_point const & begin, time_point const & end)
+	{
+		return begin < end ? static_cast<uint64_t> (std::chrono::duration_cast<duration> (end - begin).count ()) : 0;
+	}
+	shard & owner (key const & id)
+	{
+		return shards[std::hash<key>{}(id) % shards.size ()];
+	}
+	size_t home (key const & id) const
+	{
+		return std::hash<key>{}(id) % workers.size ();
+	}
+	// Lets a worker know its intake or rounds changed, only the first signal since the worker last looked takes its lock
+	void signal (size_t index)
+	{
+		auto & target = workers[index];
+		if (!target.notified.exchange (true, std::memory_order_acq_rel))
+		{
+			std::lock_guard<std::mutex> lock{ target.mutex };
+			target.condition.notify_one ();
+		}
+	}
+	void done (size_t count)
+	{
+		if (count != 0 && (outstanding -= count) == 0)
+		{
+			std::lock_guard<std::mutex> lock{ idle_mutex };
+			idle.notify_all ();
+		}
+	}
+	void schedule (std::shared_ptr<election> const & item)
+	{
+		auto current = item->state.load ();
+		while (true)
+		{
+			switch (current)
+			{
+				case status::idle:
+					if (item->state.compare_exchange_weak (current, status::queued))
+					{
+						++outstanding;
+						auto index = home (item->id);
+						auto & target = workers[index];
+						bool busy;
+						{
+							std::lock_guard<std::mutex> lock{ target.mutex };
+							target.queue.push_back (item);
+							++queued;
+							busy = !target.sleeping;
+						}
+						if (busy)
+						{
+							wake (index);
+						}
+						else
+						{
+							target.condition.notify_one ();
+						}
+						return;
+					}
+					break;
+				case status::running:
+					if (item->state.compare_exchange_weak (current, status::rerun))
+					{
+						return;
+					}
+					break;
+				default:
+					return;
+			}
+		}
+	}
+	// Wakes a sleeping worker other than busy to steal the election just queued there
+	void wake (size_t busy)
+	{
+		for (size_t i = 1, n = workers.size (); i < n && sleepers != 0; ++i)
+		{
+			auto & other = workers[(busy + i) % n];
+			std::lock_guard<std::mutex> lock{ other.mutex };
+			if (other.sleeping)
+			{
+				other.condition.notify_one ();
+				return;
+			}
+		}
+	}
+	// Takes the newest election queued on self, otherwise the oldest queued on any other worker
+	std::shared_ptr<election> take (size_t self)
+	{
+		std::shared_ptr<election> result;
+		{
+			auto & own = workers[self];
+			std::lock_guard<std::mutex> lock{ own.mutex };
+			if (!own.queue.empty ())
+			{
+				result = std::move (own.queue.back ());
+				own.queue.pop_back ();
+				--queued;
+				return result;
+			}
+		}
+		for (size_t i = 1, n = workers.size (); i < n && result == nullptr; ++i)
+		{
+			auto & victim = workers[(self + i) % n];
+			std::lock_guard<std::mutex> lock{ victim.mutex };
+			if (!victim.queue.empty ())
+			{
+				result = std::move (victim.queue.front ());
+				victim.queue.pop_front ();
+				--queued;
+			}
+		}
+		return result;
+	}
+	void run (std::shared_ptr<election> const & target)
+	{
+		auto & item = *target;
+		auto index = home (item.id);
+		auto expected = status::running;
+		auto fault = [this, &item] (validator const & from) {
+			if (this->fault)
+			{
+				this->fault (item.id, from);
+			}
+		};
+		do
+		{
+			item.state.store (status::running);
+			std::vector<entry> batch;
+			{
+				std::lock_guard<std::mutex> lock{ item.mutex };
+				batch.swap (item.pending);
+			}
+			auto now = workers[index].now.load ();
+			item.value.insert_batch (batch.begin (), batch.end (), now, validators_m, [this, &item] (object const & value, weight const & total) {
+				if (!item.confirmed.exchange (true))
+				{
+					auto const & progress = item.value.progress ();
+					quorum_m.record (ticks (progress.first, progress.quorum));
+					confirmation_m.record (ticks (progress.first, progress.confirmed));
+					confirm (item.id, value, total);
+				}
+			}, fault, hold);
+			auto wake = item.confirmed ? time_point::max () : item.value.due ();
+			if (voter && !item.confirmed)
+			{
+				if (!(now < item.next))
+				{
+					item.next = item.value.vote ([this, &item] (object const & value, time_point const & time) {
+						voter (item.id, value, time);
+					}, validators_m, now, fault) + duration{ 1 };
+				}
+				wake = std::min (wake, item.next);
+			}
+			item.wake.store (wake);
+			expected = status::running;
+		} while (!item.state.compare_exchange_strong (expected, status::idle));
+		auto wake = item.wake.load ();
+		if (wake != time_point::max ())
+		{
+			auto & owner = workers[index];
+			{
+				std::lock_guard<std::mutex> lock{ owner.mutex };
+				owner.timers.emplace_back (wake, target);
+			}
+			// Home may have moved past wake while this ran and won't look at its timers again until it's signalled
+			if (!(owner.now.load () < wake))
+			{
+				signal (index);
+			}
+		}
+		done (1);
+	}
+	// Hands every vote in the intake to its election and queues it, moves to the latest tick queueing the elections due by then
+	// then completes the rounds of flushes started before
+	void dispatch (size_t self)
+	{
+		auto & own = workers[self];
+		auto rounds = own.rounds.exchange (0);
+		auto now = now_m.load ();
+		own.incoming.take ([this] (ballot item) {
+			{
+				std::lock_guard<std::mutex> lock{ item.target->mutex };
+				item.target->pending.emplace_back (item.item, item.time, item.from);
+			}
+			schedule (item.target);
+		});
+		own.now.store (now);
+		decltype (own.timers) timers;
+		{
+			std::lock_guard<std::mutex> lock{ own.mutex };
+			timers.swap (own.timers);
+		}
+		for (auto const & [when, item]: timers)
+		{
+			own.wheel.schedule (when, item);
+		}
+		// Entries left behind by an earlier run of an election are skipped once it has a later wake time
+		own.wheel.advance (now, [this, &now] (std::weak_ptr<election> const & entry) {
+			auto item = entry.lock ();
+			if (item != nullptr && !item->confirmed && !(now < item->wake.load ()))
+			{
+				schedule (item);
+			}
+		});
+		done (rounds);
+	}
+	void loop (size_t self)
+	{
+		auto & own = workers[self];
+		while (!stopped)
+		{
+			if (own.notified.exchange (false, std::memory_order_acq_rel))
+			{
+				dispatch (self);
+			}
+			if (auto item = take (self))
+			{
+				run (item);
+			}
+			else
+			{
+				// Woken by votes or a flush for this worker, work queued here or queued on a busy worker to steal
+				// sleepers is raised before queued is checked and schedule raises queued before checking sleepers, so one of them always sees the other
+				std::unique_lock<std::mutex> lock{ own.mutex };
+				own.sleeping = true;
+				++sleepers;
+				own.condition.wait (lock, [this, &own] () { return stopped || queued != 0 || own.notified; });
+				--sleepers;
+				own.sleeping = false;
+			}
+		}
+	}
+public:
+	// confirm is called once per election after quorum has been held for hold, fault with each validator voting for two objects at once
+	elections (duration const & window, validators const & validators, confirm_function const & confirm, duration const & hold, fault_function const & fault = nullptr, size_t threads = std::max (1u, std::thread::hardware_concurrency ())) :
+	W{ window },
+	validators_m{ validators },
+	confirm{ confirm },
+	hold{ hold },
+	fault{ fault },
+	shards (threads * 16),
+	workers (threads),
+	now_m{ time_point{} }
+	{
+		for (size_t i = 0; i < threads; ++i)
+		{
+			workers[i].thread = std::thread ([this, i] () { loop (i); });
+		}
+	}
+	~elections ()
+	{
+		stopped = true;
+		for (auto & worker: workers)
+		{
+			{
+				std::lock_guard<std::mutex> lock{ worker.mutex };
+			}
+			worker.condition.notify_all ();
+			worker.thread.join ();
+		}
+	}
+	// Calls f (key, object, time) with this node's vote in every election, set before inserting any election
+	// Each new election votes at the latest tick, then again one tick after the time each vote returns until it confirms
+	void vote_through (vote_function const & f)
+	{
+		voter = f;
+	}
+	// Starts an election for id with item as the initial choice, returns false if it already exists
+	bool insert (key const & id, object const & item)
+	{
+		std::shared_ptr<election> created;
+		{
+			auto & shard = owner (id);
+			std::lock_guard<std::mutex> lock{ shard.mutex };
+			auto [existing, inserted] = shard.items.try_emplace (id, nullptr);
+			if (!inserted)
+			{
+				return false;
+			}
+			existing->second = created = std::make_shared<election> (W, id, item);
+		}
+		if (voter)
+		{
+			schedule (created);
+		}
+		return true;
+	}
+	void erase (key const & id)
+	{
+		auto & shard = owner (id);
+		std::lock_guard<std::mutex> lock{ shard.mutex };
+		shard.items.erase (id);
+	}
+	// Routes a vote to the intake of the election's home worker, returns false if there's no such election
+	// Safe to call from any thread
+	bool vote (key const & id, object const & item, time_point const & time, validator const & from)
+	{
+		std::shared_ptr<election> target;
+		{
+			auto & shard = owner (id);
+			std::lock_guard<std::mutex> lock{ shard.mutex };
+			auto existing = shard.items.find (id);
+			if (existing == shard.items.end ())
+			{
+				return false;
+			}
+			target = existing->second;
+		}
+		auto index = home (id);
+		workers[index].incoming.push (ballot{ std::move (target), item, time, from });
+		signal (index);
+		return true;
+	}
+	// Moves time forward to now, each worker queues the elections due by then once it has handed over the votes routed before the call
+	void tick (time_point const & now)
+	{
+		now_m.store (now);
+		for (size_t i = 0; i < workers.size (); ++i)
+		{
+			signal (i);
+		}
+	}
+	// Blocks until every vote routed before the call has been handed to its election and every queued election has been run
+	void flush ()
+	{
+		outstanding += workers.size ();
+		for (size_t i = 0; i < workers.size (); ++i)
+		{
+			++workers[i].rounds;
+			signal (i);
+		}
+		std::unique_lock<std::mutex> lock{ idle_mutex };
+		idle.wait (lock, [this] () { return outstanding == 0; });
+	}
+	// Time from first vote to confirmation of every election confirmed so far in units of duration, readable from any thread while elections run
+	histogram<> const & latency () const
+	{
+		return confirmation_m;
+	}
+	// Time from first vote to quorum first being held, confirmation follows once quorum has been held for the hold width
+	histogram<> const & quorum_latency () const
+	{
+		return quorum_m;
+	}
+	size_t size ()
+	{
+		size_t result = 0;
+		for (auto & shard: shards)
+		{
+			std::lock_guard<std::mutex> lock{ shard.mutex };
+			result += shard.items.size ();
+		}
+		return result;
+	}
+};
+}
@@ -1,55 +1,79 @@
 import csv
 import glob
 import matplotlib.pyplot as plt
+import numpy as np
 import os
 import sys
 
+# Loads an edge file written by nano::edge_writer in to (time, object, weight) columns
+def load_edges (path):
+	data = np.fromfile (path, dtype=np.uint8)
+	if bytes (data[:8]) != b'nanoedge':
+		raise ValueError (path + " is not an edge file")
+	version = int (data[8:10].view ('<u2')[0])
+	if version != 1:
+		raise ValueError ("Unsupported edge file version " + str (version))
+	kinds = { ord ('b'): 'b', ord ('i'): 'i', ord ('u'): 'u', ord ('f'): 'f' }
+	def dtype (tag, size):
+		return np.dtype ('?') if kinds[tag] == 'b' else np.dtype ('<' + kinds[tag] + str (size))
+	object_type = dtype (data[10], data[11])
+	weight_type = dtype (data[12], data[13])
+	times = []
+	objects = []
+	weights = []
+	position = 16
+	while position < len (data):
+		rows = int (data[position:position + 4].view ('<u4')[0])
+		width = int (data[position + 4])
+		base = int (data[position + 8:position + 16].view ('<i8')[0])
+		position += 16
+		if width == 0:
+			times.append (data[position:position + rows * 8].view ('<i8'))
+			position += rows * 8
+		else:
+			deltas = data[position:position + rows * width].view ('<u' + str (width)).astype (np.int64)
+			times.append (base + np.cumsum (deltas))
+			position += rows * width
+		objects.append (data[position:position + rows * object_type.itemsize].view (object_type))
+		position += rows * object_type.itemsize
+		weights.append (data[position:position + rows * weight_type.itemsize].view (weight_type))
+		position += rows * weight_type.itemsize
+	if not times:
+		return np.empty (0, np.int64), np.empty (0, object_type), np.empty (0, weight_type)
+	return np.concatenate (times), np.concatenate (objects), np.concatenate (weights)
+
+# Loads the older CSV dumps in to the same columns
+def load_csv (path):
+	with open (path, 'r') as file:
+		rows = list (csv.reader (file))
+	return np.array ([int (row[0]) for row in rows], np.int64), np.array ([row[1] for row in rows]), np.array ([int (row[2]) for row in rows])
+
 if (len (sys.argv) != 2):
 	print ("Usage: graph <directory/file>")
 	exit (1)
 
 files = []
 if os.path.isdir (sys.argv[1]):
-	files = glob.glob (sys.argv[1] + "/*.csv")
+	files = glob.glob (sys.argv[1] + "/*.bin") + glob.glob (sys.argv[1] + "/*.csv")
 else:
 	files = [sys.argv[1]]
 print (files)
 
-
 for file in files:
 	print (file)
-	labels = []
+	times, objects, weights = load_csv (file) if file.endswith (".csv") else load_edges (file)
+	# One sample per distinct edge time, objects not in the tally at a time have no weight there
+	labels, sample = np.unique (times, return_inverse=True)
 	value_samples = {}
-	quorum = []
-
-	with open (file, 'r') as file:
-		points = csv.reader (file)
-		samples = -1
-		last_time = None
-		for row in points:
-			time, value, weight = row
-			if time != last_time:
-				last_time = time
-				samples = samples + 1
-				labels.append (time)
-				quorum.append (3)
-			if value not in value_samples.keys ():
-				print (value)
-				new_samples = []
-				for i in range (samples):
-					new_samples.append (0)
-				value_samples[value] = new_samples
-			value_samples[value].append (int(weight))
-			print (labels, len (labels))
-			print (value_samples)
-			for value in value_samples.values():
-				print (len(value))
+	for value in np.unique (objects):
+		samples = np.zeros (len (labels), np.int64)
+		selected = objects == value
+		samples[sample[selected]] = weights[selected]
+		value_samples[str (value)] = samples
+	quorum = np.full (len (labels), 3)
 
 	fig, ax = plt.subplots()
 
-	bottom = None
-	width = 0.35
-
 	fig.suptitle (file)
 	ax.plot (labels, quorum, label='quorum')
 	for value in value_samples:
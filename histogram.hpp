@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+namespace nano
+{
+// Log-linear histogram of unsigned values in the style of HdrHistogram, safe to record in to and read from any thread
+// Values below 2^BITS are counted exactly, larger ones in buckets 2^(1 - BITS) of their value wide, so any reported value is within that fraction of the true one
+// Recording is one relaxed increment of a fixed bucket so it's cheap enough to do for every election
+template<size_t BITS = 8>
+class histogram
+{
+	static_assert (BITS >= 2 && BITS < 32, "Bucket precision out of range");
+	static size_t constexpr half = size_t{ 1 } << (BITS - 1);
+public:
+	static size_t constexpr size = ((64 - BITS) << (BITS - 1)) + (size_t{ 1 } << BITS);
+	static size_t index (uint64_t value)
+	{
+		if (value >> BITS == 0)
+		{
+			return static_cast<size_t> (value);
+		}
+		size_t top = 63 - __builtin_clzll (value);
+		auto shift = top - BITS + 1;
+		return (shift << (BITS - 1)) + static_cast<size_t> (value >> shift);
+	}
+	// Smallest value counted in bucket index
+	static uint64_t lowest (size_t index)
+	{
+		if (index >> BITS == 0)
+		{
+			return index;
+		}
+		auto shift = (index >> (BITS - 1)) - 1;
+		return static_cast<uint64_t> (index - (shift << (BITS - 1))) << shift;
+	}
+	// Largest value counted in bucket index
+	static uint64_t highest (size_t index)
+	{
+		return index + 1 < size ? lowest (index + 1) - 1 : std::numeric_limits<uint64_t>::max ();
+	}
+private:
+	// Held on the heap since a manager holding a few of these would otherwise be hundreds of kilobytes
+	std::unique_ptr<std::array<std::atomic<uint64_t>, size>> counts{ std::make_unique<std::array<std::atomic<uint64_t>, size>> () };
+	std::atomic<uint64_t> total_m{ 0 };
+	std::atomic<uint64_t> max_m{ 0 };
+public:
+	void record (uint64_t value)
+	{
+		(*counts)[index (value)].fetch_add (1, std::memory_order_relaxed);
+		total_m.fetch_add (1, std::memory_order_relaxed);
+		auto current = max_m.load (std::memory_order_relaxed);
+		while (current < value && !max_m.compare_exchange_weak (current, value, std::memory_order_relaxed));
+	}
+	uint64_t count () const
+	{
+		return total_m.load (std::memory_order_relaxed);
+	}
+	uint64_t max () const
+	{
+		return max_m.load (std::memory_order_relaxed);
+	}
+	// Value at or below which fraction p of recorded values fall, reported as the top of its bucket and never above max
+	// Reads while values are being recorded see each bucket at some point during the call
+	uint64_t percentile (double p) const
+	{
+		auto total = count ();
+		if (total == 0)
+		{
+			return 0;
+		}
+		auto rank = static_cast<uint64_t> (p * total + 0.5);
+		rank = std::max<uint64_t> (1, std::min (rank, total));
+		uint64_t seen = 0;
+		for (size_t i = 0; i < size; ++i)
+		{
+			seen += (*counts)[i].load (std::memory_order_relaxed);
+			if (seen >= rank)
+			{
+				return std::min (highest (i), max ());
+			}
+		}
+		return max ();
+	}
+	void reset ()
+	{
+		for (auto & item: *counts)
+		{
+			item.store (0, std::memory_order_relaxed);
+		}
+		total_m.store (0, std::memory_order_relaxed);
+		max_m.store (0, std::memory_order_relaxed);
+	}
+};
+}
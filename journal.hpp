@@ -0,0 +1,288 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace nano
+{
+// Append-only, memory-mapped file of the votes inserted in to one agreement so they can be replayed after a restart
+// Each record carries a checksum, replay stops at the first record which fails it so a torn final write is discarded
+// Objects, validators and time points are stored as their raw bytes and must be trivially copyable
+template <typename AGREEMENT>
+class journal
+{
+public:
+	using agreement = AGREEMENT;
+	using object = typename agreement::object;
+	using time_point = typename agreement::time_point;
+	using validator = typename agreement::validator;
+private:
+	static_assert (std::is_trivially_copyable<object>::value && std::is_trivially_copyable<validator>::value && std::is_trivially_copyable<time_point>::value, "Journaled votes must be trivially copyable");
+	static uint64_t constexpr magic = 0x6c6e72756f6a6f6eULL;
+	static size_t constexpr header = 16;
+	static size_t constexpr payload = sizeof (time_point) + sizeof (validator) + sizeof (object);
+	// Payload followed by a 32-bit checksum, padded to 8 bytes
+	static size_t constexpr stride = (payload + sizeof (uint32_t) + 7) / 8 * 8;
+	std::filesystem::path path;
+	int file{ -1 };
+	uint8_t * base{ nullptr };
+	size_t capacity{ 0 };
+	size_t count{ 0 };
+	// FNV-1a seeded with the record's index so a valid record copied to another slot doesn't validate there
+	static uint32_t checksum (uint8_t const * data, size_t size, size_t position)
+	{
+		uint32_t result = 2166136261u ^ static_cast<uint32_t> (position);
+		for (size_t i = 0; i < size; ++i)
+		{
+			result = (result ^ data[i]) * 16777619u;
+		}
+		return result;
+	}
+	[[noreturn]] static void fail (char const * what)
+	{
+		throw std::system_error (errno, std::generic_category (), what);
+	}
+	uint8_t * slot (size_t index) const
+	{
+		return base + header + index * stride;
+	}
+	void map (size_t size)
+	{
+		if (base != nullptr)
+		{
+			munmap (base, capacity);
+			base = nullptr;
+		}
+		if (ftruncate (file, static_cast<off_t> (size)) != 0)
+		{
+			fail ("journal resize");
+		}
+		auto address = mmap (nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		if (address == MAP_FAILED)
+		{
+			fail ("journal map");
+		}
+		base = static_cast<uint8_t *> (address);
+		capacity = size;
+	}
+	// Throws unless the file starts with this journal's magic and record stride, read before mapping so a foreign file is left untouched
+	void check ()
+	{
+		uint64_t found[2] = { 0, 0 };
+		auto read = pread (file, found, sizeof (found), 0);
+		if (read < 0)
+		{
+			fail ("journal read");
+		}
+		if (static_cast<size_t> (read) != sizeof (found) || found[0] != magic || found[1] != stride)
+		{
+			throw std::runtime_error ("journal header not recognised: " + path.string ());
+		}
+	}
+	void open (size_t initial)
+	{
+		file = ::open (path.c_str (), O_RDWR | O_CREAT, 0644);
+		if (file < 0)
+		{
+			fail ("journal open");
+		}
+		// The destructor doesn't run when a constructor throws
+		try
+		{
+			struct stat info;
+			if (fstat (file, &info) != 0)
+			{
+				fail ("journal stat");
+			}
+			auto existing = static_cast<size_t> (info.st_size);
+			if (existing != 0)
+			{
+				check ();
+			}
+			map (std::max (existing, header + initial / stride * stride + stride));
+			if (existing == 0)
+			{
+				// New file, start empty
+				uint64_t size = stride;
+				std::memcpy (base, &magic, sizeof (magic));
+				std::memcpy (base + sizeof (magic), &size, sizeof (size));
+			}
+			count = 0;
+			while (header + (count + 1) * stride <= capacity && valid (count))
+			{
+				++count;
+			}
+			// Clears everything after the last valid record so records beyond a torn one can't reappear once it's overwritten
+			std::memset (slot (count), 0, capacity - (header + count * stride));
+		}
+		catch (...)
+		{
+			close ();
+			throw;
+		}
+	}
+	bool valid (size_t index) const
+	{
+		auto record = slot (index);
+		uint32_t stored;
+		std::memcpy (&stored, record + payload, sizeof (stored));
+		return stored == checksum (record, payload, index);
+	}
+	void write (size_t index, object const & item, time_point const & time, validator const & from)
+	{
+		auto record = slot (index);
+		std::memcpy (record, &time, sizeof (time));
+		std::memcpy (record + sizeof (time), &from, sizeof (from));
+		std::memcpy (record + sizeof (time) + sizeof (from), &item, sizeof (item));
+		auto sum = checksum (record, payload, index);
+		std::memcpy (record + payload, &sum, sizeof (sum));
+	}
+	void close ()
+	{
+		if (base != nullptr)
+		{
+			munmap (base, capacity);
+			base = nullptr;
+		}
+		if (file >= 0)
+		{
+			::close (file);
+			file = -1;
+		}
+	}
+public:
+	// Opens or creates the journal at path, records already in it are kept for replay
+	// Throws if path is a non-empty file that isn't a journal of this record layout, leaving it unchanged
+	journal (std::filesystem::path const & path, size_t initial = 1 << 20) :
+	path{ path }
+	{
+		open (initial);
+	}
+	journal (journal const &) = delete;
+	~journal ()
+	{
+		close ();
+	}
+	void append (object const & item, time_point const & time, validator const & from)
+	{
+		if (header + (count + 1) * stride > capacity)
+		{
+			map (header + (capacity - header) / stride * 2 * stride);
+		}
+		write (count, item, time, from);
+		++count;
+	}
+	// Calls f (object, time, validator) for every record in append order, returns the number of records
+	template<typename FUNCTION>
+	size_t replay (FUNCTION f) const
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			auto record = slot (i);
+			time_point time;
+			validator from;
+			object item;
+			std::memcpy (&time, record, sizeof (time));
+			std::memcpy (&from, record + sizeof (time), sizeof (from));
+			std::memcpy (&item, record + sizeof (time) + sizeof (from), sizeof (item));
+			f (item, time, from);
+		}
+		return count;
+	}
+	// Inserts every journaled vote in to target, done before target writes through to this journal
+	size_t restore (agreement & target) const
+	{
+		return replay ([&target] (object const & item, time_point const & time, validator const & from) {
+			target.insert (item, time, from);
+		});
+	}
+	// Restores target then writes every vote inserted in to it through to this journal, which must outlive the write through
+	size_t attach (agreement & target)
+	{
+		auto result = restore (target);
+		target.write_through ([this] (object const & item, time_point const & time, validator const & from) {
+			append (item, time, from);
+		});
+		return result;
+	}
+	// Rewrites the journal without records older than cutoff, returns the number dropped
+	// The rewrite goes to a separate file renamed over the journal so a crash part way leaves the original intact
+	size_t compact (time_point const & cutoff)
+	{
+		std::vector<std::tuple<object, time_point, validator>> kept;
+		replay ([&kept, &cutoff] (object const & item, time_point const & time, validator const & from) {
+			if (!(time < cutoff))
+			{
+				kept.emplace_back (item, time, from);
+			}
+		});
+		auto result = count - kept.size ();
+		auto target = path;
+		target += ".compact";
+		std::filesystem::remove (target);
+		{
+			journal compacted{ target, kept.size () * stride };
+			for (auto const & [item, time, from]: kept)
+			{
+				compacted.append (item, time, from);
+			}
+			compacted.sync ();
+		}
+		// Renamed while still mapped so a failed rename leaves this journal as it was
+		try
+		{
+			std::filesystem::rename (target, path);
+		}
+		catch (...)
+		{
+			std::error_code ignored;
+			std::filesystem::remove (target, ignored);
+			throw;
+		}
+		// A failed remap puts the previous mapping back so base stays valid, though it now maps the file replaced by the rename
+		auto previous = std::make_tuple (file, base, capacity, count);
+		file = -1;
+		base = nullptr;
+		try
+		{
+			open (0);
+		}
+		catch (...)
+		{
+			std::tie (file, base, capacity, count) = previous;
+			throw;
+		}
+		munmap (std::get<1> (previous), std::get<2> (previous));
+		::close (std::get<0> (previous));
+		return result;
+	}
+	// Flushes appended records to disk
+	void sync ()
+	{
+		if (msync (base, capacity, MS_SYNC) != 0)
+		{
+			fail ("journal sync");
+		}
+	}
+	size_t size () const
+	{
+		return count;
+	}
+	// Bytes written per vote
+	static size_t constexpr record_bytes = stride;
+};
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace nano
+{
+// Compact binary encoding used by agreement and tally snapshots
+namespace serial
+{
+// Appends encoded values to a contiguous byte buffer
+class writer
+{
+	std::vector<uint8_t> buffer_m;
+public:
+	void write (void const * data, size_t size)
+	{
+		auto offset = buffer_m.size ();
+		buffer_m.resize (offset + size);
+		std::memcpy (buffer_m.data () + offset, data, size);
+	}
+	// Overwrites bytes already written at offset, e.g. a length only known once what follows it is written
+	void patch (size_t offset, void const * data, size_t size)
+	{
+		std::memcpy (buffer_m.data () + offset, data, size);
+	}
+	void reserve (size_t size)
+	{
+		buffer_m.reserve (size);
+	}
+	size_t size () const
+	{
+		return buffer_m.size ();
+	}
+	std::vector<uint8_t> const & buffer () const
+	{
+		return buffer_m;
+	}
+};
+// Reads encoded values back from a byte range, reading past its end sets error and yields zeroed values
+class reader
+{
+	uint8_t const * position;
+	uint8_t const * end;
+	bool error_m{ false };
+public:
+	reader (uint8_t const * data, size_t size) :
+	position{ data },
+	end{ data + size }
+	{
+	}
+	reader (std::vector<uint8_t> const & buffer) :
+	reader{ buffer.data (), buffer.size () }
+	{
+	}
+	bool read (void * data, size_t size)
+	{
+		if (error_m || static_cast<size_t> (end - position) < size)
+		{
+			error_m = true;
+			std::memset (data, 0, size);
+			return false;
+		}
+		std::memcpy (data, position, size);
+		position += size;
+		return true;
+	}
+	bool skip (size_t size)
+	{
+		if (error_m || static_cast<size_t> (end - position) < size)
+		{
+			error_m = true;
+			return false;
+		}
+		position += size;
+		return true;
+	}
+	// Number of unread bytes
+	size_t remaining () const
+	{
+		return end - position;
+	}
+	bool error () const
+	{
+		return error_m;
+	}
+	// Marks the input malformed, later reads yield zeroed values
+	void fail ()
+	{
+		error_m = true;
+	}
+};
+// Encoding of one value, trivially copyable types are copied byte for byte
+// Other object or validator types opt in by specializing with static write (writer &, T const &) and read (reader &, T &)
+template<typename T, typename = void>
+class codec;
+template<typename T>
+class codec<T, std::enable_if_t<std::is_trivially_copyable<T>::value>>
+{
+public:
+	static void write (writer & out, T const & value)
+	{
+		out.write (&value, sizeof (value));
+	}
+	static void read (reader & in, T & value)
+	{
+		in.read (&value, sizeof (value));
+	}
+};
+// Written as one byte, any byte other than 0 or 1 is malformed instead of being copied in to a bool
+template<>
+class codec<bool>
+{
+public:
+	static void write (writer & out, bool const & value)
+	{
+		uint8_t byte = value;
+		out.write (&byte, sizeof (byte));
+	}
+	static void read (reader & in, bool & value)
+	{
+		uint8_t byte = 0;
+		in.read (&byte, sizeof (byte));
+		if (byte > 1)
+		{
+			in.fail ();
+		}
+		value = byte == 1;
+	}
+};
+template<typename T>
+void put (writer & out, T const & value)
+{
+	codec<T>::write (out, value);
+}
+template<typename T>
+void get (reader & in, T & value)
+{
+	codec<T>::read (in, value);
+}
+// Sizes are always 64-bit so snapshots move between platforms
+inline void put_size (writer & out, size_t value)
+{
+	put (out, static_cast<uint64_t> (value));
+}
+// Reads a count of items each at least min bytes, counts the remaining input can't hold are an error so a corrupt size never allocates
+inline size_t get_size (reader & in, size_t min = 1)
+{
+	uint64_t result = 0;
+	get (in, result);
+	if (min != 0 && result > in.remaining () / min)
+	{
+		in.fail ();
+		return 0;
+	}
+	return static_cast<size_t> (result);
+}
+}
+}
@@ -0,0 +1,286 @@
+#pragma once
+
+#include "agreement.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace nano
+{
+// Virtual clock moved forward by a simulator instead of by wall time
+// Each thread has its own current time so independent simulations can run side by side
+class simulated_clock
+{
+public:
+	using duration = std::chrono::microseconds;
+	using rep = duration::rep;
+	using period = duration::period;
+	using time_point = std::chrono::time_point<simulated_clock>;
+	static bool constexpr is_steady = true;
+	static time_point now ()
+	{
+		return current;
+	}
+	// Starts after the epoch since a zero time marks an empty slot inside tallies
+	static inline thread_local time_point current{ std::chrono::seconds{ 1 } };
+};
+// Single threaded discrete event simulation of one agreement per validator voting over a network
+// Every link adds a fixed latency chosen per round plus per message jitter, so messages reorder, and drops messages with a set probability
+// Faulty validators vote honestly but also send every peer its own random choice each time they vote
+// A round is entirely determined by its seed so any failing round can be replayed exactly
+template <typename AGREEMENT>
+class simulator
+{
+public:
+	using agreement = AGREEMENT;
+	using object = typename agreement::object;
+	using validators = typename agreement::validators;
+	using validator = typename agreement::validator;
+	using duration = typename agreement::duration;
+	using time_point = typename agreement::time_point;
+	static_assert (std::is_same<typename agreement::clock, simulated_clock>::value, "Simulated agreements need simulated_clock");
+private:
+	static std::vector<object> default_choices ()
+	{
+		if constexpr (std::is_same<object, bool>::value)
+		{
+			return { false, true };
+		}
+		else
+		{
+			return { object{} };
+		}
+	}
+public:
+	class parameters
+	{
+	public:
+		duration W{ 50 };
+		// Quorum has to be held this long to confirm
+		duration hold{ 101 };
+		// Each link's latency is drawn from [latency_min, latency_max] once per round, each message adds up to jitter more
+		simulated_clock::duration latency_min{ std::chrono::milliseconds{ 1 } };
+		simulated_clock::duration latency_max{ std::chrono::milliseconds{ 20 } };
+		simulated_clock::duration jitter{ std::chrono::milliseconds{ 10 } };
+		// Probability of a message being lost
+		double drop{ 0.0 };
+		// Validators vote again this often
+		simulated_clock::duration interval{ std::chrono::milliseconds{ 10 } };
+		// The first faulty validators in the key list are faulty
+		size_t faulty{ 0 };
+		// Rounds ending without every validator confirming are counted as stalled
+		simulated_clock::duration timeout{ std::chrono::seconds{ 10 } };
+		// Objects initial and faulty votes are drawn from, both values of a binary agreement by default
+		std::vector<object> choices{ default_choices () };
+	};
+	class result
+	{
+	public:
+		uint64_t seed{ 0 };
+		// Every validator confirmed before the timeout
+		bool live{ false };
+		// Distinct objects confirmed by any validator
+		size_t confirmed{ 0 };
+		// Time from the start of the round until each validator confirmed, absent if it didn't
+		std::vector<std::optional<simulated_clock::duration>> latency;
+		uint64_t messages{ 0 };
+		uint64_t events{ 0 };
+		bool safe () const
+		{
+			return confirmed <= 1;
+		}
+	};
+private:
+	class event
+	{
+	public:
+		time_point time;
+		// Breaks ties between events at the same time in the order they were scheduled
+		uint64_t sequence;
+		uint32_t to;
+		// Ticks wake a validator to vote, other events deliver the vote below
+		bool tick;
+		object item;
+		time_point vote_time;
+		validator from;
+		bool operator< (event const & other) const
+		{
+			return other.time < time || (time == other.time && other.sequence < sequence);
+		}
+	};
+	class node
+	{
+	public:
+		std::unique_ptr<agreement> value;
+		std::optional<object> confirmed;
+	};
+	validators const & validators_m;
+	std::vector<validator> keys;
+	parameters params;
+	std::vector<node> nodes;
+	// Per round latency of every link, from * size + to
+	std::vector<simulated_clock::duration> links;
+	std::vector<event> queue;
+	uint64_t sequence{ 0 };
+	uint64_t state{ 0 };
+	result current;
+	// splitmix64, used instead of the standard distributions so a seed replays identically with any standard library
+	uint64_t next ()
+	{
+		auto result = (state += 0x9e3779b97f4a7c15ULL);
+		result = (result ^ (result >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		result = (result ^ (result >> 27)) * 0x94d049bb133111ebULL;
+		return result ^ (result >> 31);
+	}
+	uint64_t below (uint64_t bound)
+	{
+		return bound == 0 ? 0 : next () % bound;
+	}
+	bool chance (double probability)
+	{
+		return (next () >> 11) * 0x1.0p-53 < probability;
+	}
+	simulated_clock::duration between (simulated_clock::duration const & min, simulated_clock::duration const & max)
+	{
+		return min + simulated_clock::duration{ below (static_cast<uint64_t> ((max - min).count ()) + 1) };
+	}
+	void push (event && item)
+	{
+		item.sequence = sequence++;
+		queue.push_back (std::move (item));
+		std::push_heap (queue.begin (), queue.end ());
+	}
+	void send (uint32_t from, uint32_t to, object const & item, time_point const & time)
+	{
+		++current.messages;
+		if (from == to)
+		{
+			push (event{ time, 0, to, false, item, time, keys[from] });
+		}
+		else if (!chance (params.drop))
+		{
+			auto arrival = time + links[from * nodes.size () + to] + between (simulated_clock::duration{}, params.jitter);
+			push (event{ arrival, 0, to, false, item, time, keys[from] });
+		}
+	}
+	void broadcast (uint32_t from, object const & item, time_point const & time)
+	{
+		for (uint32_t to = 0; to < nodes.size (); ++to)
+		{
+			send (from, to, item, time);
+		}
+	}
+	void advance (uint32_t self, time_point const & now, time_point const & start)
+	{
+		auto & target = nodes[self];
+		target.value->advance (now, validators_m, [this, &target, self, &now, &start] (object const & value, typename agreement::weight const &) {
+			if (!target.confirmed)
+			{
+				target.confirmed = value;
+				current.latency[self] = now - start;
+			}
+		}, agreement::fault_null, params.hold);
+	}
+	void tick (uint32_t self, time_point const & now)
+	{
+		auto & target = nodes[self];
+		auto when = target.value->vote ([this, self] (object const & item, time_point const & time) { broadcast (self, item, time); }, validators_m, now);
+		if (self < params.faulty)
+		{
+			for (uint32_t to = 0; to < nodes.size (); ++to)
+			{
+				if (to != self)
+				{
+					send (self, to, params.choices[below (params.choices.size ())], now);
+				}
+			}
+		}
+		// A vote blocked until when is retried just after it so the expiring vote has left the window
+		auto wake = when < now + params.interval ? when + simulated_clock::duration{ 1 } : now + params.interval;
+		push (event{ wake, 0, self, true, object{}, time_point{}, validator{} });
+	}
+public:
+	simulator (validators const & validators, std::vector<validator> const & keys, parameters const & params) :
+	validators_m{ validators },
+	keys{ keys },
+	params{ params },
+	nodes (keys.size ()),
+	links (keys.size () * keys.size ())
+	{
+		if (params.choices.empty ())
+		{
+			throw std::invalid_argument ("simulator needs at least one choice");
+		}
+	}
+	// Runs one round from seed until every validator has confirmed or the timeout passes
+	result const & run (uint64_t seed)
+	{
+		state = seed;
+		sequence = 0;
+		queue.clear ();
+		current = result{};
+		current.seed = seed;
+		current.latency.assign (nodes.size (), std::nullopt);
+		auto start = simulated_clock::time_point{ std::chrono::seconds{ 1 } };
+		simulated_clock::current = start;
+		for (auto & link: links)
+		{
+			link = between (params.latency_min, params.latency_max);
+		}
+		for (uint32_t i = 0; i < nodes.size (); ++i)
+		{
+			auto & target = nodes[i];
+			target.value = std::make_unique<agreement> (params.W, params.choices[below (params.choices.size ())]);
+			target.value->confirm_once ();
+			target.value->retain (100 * params.W);
+			target.confirmed.reset ();
+			broadcast (i, target.value->last, start);
+			push (event{ start + between (simulated_clock::duration{ 1 }, params.interval), 0, i, true, object{}, time_point{}, validator{} });
+		}
+		size_t remaining = nodes.size ();
+		auto deadline = start + params.timeout;
+		while (remaining != 0 && !queue.empty () && queue.front ().time <= deadline)
+		{
+			std::pop_heap (queue.begin (), queue.end ());
+			auto item = std::move (queue.back ());
+			queue.pop_back ();
+			++current.events;
+			simulated_clock::current = item.time;
+			auto was = nodes[item.to].confirmed.has_value ();
+			if (item.tick)
+			{
+				advance (item.to, item.time, start);
+				tick (item.to, item.time);
+			}
+			else
+			{
+				nodes[item.to].value->insert (item.item, item.vote_time, item.from);
+				advance (item.to, item.time, start);
+			}
+			remaining -= !was && nodes[item.to].confirmed.has_value ();
+		}
+		current.live = remaining == 0;
+		std::vector<object> values;
+		for (auto const & target: nodes)
+		{
+			if (target.confirmed && std::find (values.begin (), values.end (), *target.confirmed) == values.end ())
+			{
+				values.push_back (*target.confirmed);
+			}
+		}
+		current.confirmed = values.size ();
+		return current;
+	}
+	// Agreement held by the validator at index in the key list, as left by the last round
+	agreement & operator[] (size_t index)
+	{
+		return *nodes[index].value;
+	}
+};
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "agreement.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace nano
+{
+// Checkpoints a set of agreements, with every ancestor they link to, in to one buffer and restores them in bulk
+// The number of entries is followed by each agreement, written as its window, the length of its state then the state from agreement::save
+// Restoring constructs every agreement in a first pass so parents link by id regardless of the order they were written in
+// Each restored agreement costs two allocations, itself and its vote log sized from the decoded count, containers of a live window add their own
+template <typename AGREEMENT>
+class snapshot
+{
+public:
+	using agreement = AGREEMENT;
+	using object = typename agreement::object;
+	using duration = typename agreement::duration;
+private:
+	static uint64_t constexpr magic = 0x746f687370616e73ULL;
+public:
+	// Saves the agreements in [first, last), a range of shared_ptr, followed by any ancestors not in it
+	template<typename It>
+	static serial::writer save (It first, It last)
+	{
+		serial::writer out;
+		std::vector<agreement const *> queue;
+		std::unordered_map<agreement const *, uint64_t> ids;
+		auto index = [&queue, &ids] (agreement const * item) {
+			auto [existing, inserted] = ids.try_emplace (item, queue.size ());
+			if (inserted)
+			{
+				queue.push_back (item);
+			}
+			return existing->second;
+		};
+		size_t votes = 0;
+		for (auto i = first; i != last; ++i)
+		{
+			index (i->get ());
+			votes += (*i)->size ();
+		}
+		out.reserve (votes * agreement::vote_bytes + queue.size () * 256);
+		serial::put (out, magic);
+		// Number of entries, patched once every ancestor has been found
+		auto count = out.size ();
+		serial::put (out, uint64_t{ 0 });
+		// Parents found while saving are appended to queue
+		for (size_t i = 0; i < queue.size (); ++i)
+		{
+			auto item = queue[i];
+			serial::put (out, item->W);
+			auto offset = out.size ();
+			serial::put (out, uint64_t{ 0 });
+			item->save (out, index);
+			uint64_t length = out.size () - offset - sizeof (length);
+			out.patch (offset, &length, sizeof (length));
+		}
+		uint64_t entries = queue.size ();
+		out.patch (count, &entries, sizeof (entries));
+		return out;
+	}
+	// Restores every agreement written by save, the saved range first in its original order followed by ancestors
+	// Returns an empty vector if the input is malformed
+	static std::vector<std::shared_ptr<agreement>> restore (serial::reader in)
+	{
+		std::vector<std::shared_ptr<agreement>> result;
+		uint64_t found = 0;
+		serial::get (in, found);
+		auto count = serial::get_size (in, 0);
+		if (found != magic)
+		{
+			return result;
+		}
+		auto entries = in;
+		// Each entry holds at least its window and length
+		result.reserve (std::min<size_t> (count, in.remaining () / (sizeof (duration) + sizeof (uint64_t))));
+		while (in.remaining () != 0 && !in.error ())
+		{
+			auto window = duration{};
+			serial::get (in, window);
+			in.skip (serial::get_size (in));
+			result.push_back (std::make_shared<agreement> (window, object{}));
+		}
+		auto lookup = [&result] (uint64_t id) {
+			return id < result.size () ? result[id] : nullptr;
+		};
+		auto valid = !in.error () && count == result.size ();
+		for (size_t i = 0; valid && i < result.size (); ++i)
+		{
+			auto window = duration{};
+			serial::get (entries, window);
+			uint64_t length = 0;
+			serial::get (entries, length);
+			auto remaining = entries.remaining ();
+			valid = result[i]->load (entries, lookup) && remaining - entries.remaining () == length;
+		}
+		if (!valid)
+		{
+			result.clear ();
+		}
+		return result;
+	}
+	// Writes the snapshot of [first, last) to path in one sequential write, returns false on failure
+	template<typename It>
+	static bool save (It first, It last, std::filesystem::path const & path)
+	{
+		auto out = save (first, last);
+		std::ofstream stream{ path, std::ios::binary | std::ios::trunc };
+		stream.write (reinterpret_cast<char const *> (out.buffer ().data ()), out.buffer ().size ());
+		stream.flush ();
+		return static_cast<bool> (stream);
+	}
+	// Maps the file instead of reading it in to a buffer, returns an empty vector if it can't be read or is malformed
+	static std::vector<std::shared_ptr<agreement>> restore (std::filesystem::path const & path)
+	{
+		std::vector<std::shared_ptr<agreement>> result;
+		auto file = ::open (path.c_str (), O_RDONLY);
+		if (file < 0)
+		{
+			return result;
+		}
+		struct stat info;
+		if (fstat (file, &info) == 0 && info.st_size > 0)
+		{
+			auto size = static_cast<size_t> (info.st_size);
+			auto address = mmap (nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+			if (address != MAP_FAILED)
+			{
+				madvise (address, size, MADV_SEQUENTIAL);
+				result = restore (serial::reader{ static_cast<uint8_t const *> (address), size });
+				munmap (address, size);
+			}
+		}
+		::close (file);
+		return result;
+	}
+};
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace nano
+{
+// Events counted on agreement's hot paths
+enum class counter : uint8_t
+{
+	// Edges emitted by sweeps over the vote log, from scan, tally and advance
+	edges,
+	// Agreements visited walking ancestors
+	ancestors,
+	// Faults reported by tally::rise
+	faults,
+	// Votes vote withheld because an ancestor wasn't replaceable yet
+	suppressed,
+	size
+};
+// Distributions recorded on agreement's hot paths, durations in nanoseconds
+enum class measure : uint8_t
+{
+	scan,
+	tally,
+	advance,
+	vote,
+	// Duration and number of agreements visited by each walk over ancestors
+	walk,
+	walk_length,
+	size
+};
+// Default statistics policy of agreement, every call is empty and the timer holds nothing so instrumented paths compile to the same code as without it
+class stats_null
+{
+public:
+	static void count (counter, uint64_t = 1)
+	{
+	}
+	static void observe (measure, uint64_t)
+	{
+	}
+	class timer
+	{
+	public:
+		explicit timer (measure)
+		{
+		}
+	};
+};
+// Statistics policy keeping process wide counters and base 2 histograms in relaxed atomics
+// Instances of agreement sharing a TAG share statistics, write exports them in the Prometheus text format
+template<typename TAG = void>
+class stats
+{
+public:
+	// Bucket i counts values below 2^i, the last bucket also holds everything larger
+	static size_t constexpr buckets = 40;
+	class histogram
+	{
+	public:
+		std::array<std::atomic<uint64_t>, buckets> counts{};
+		std::atomic<uint64_t> sum{ 0 };
+		std::atomic<uint64_t> total{ 0 };
+		void observe (uint64_t value)
+		{
+			size_t index = 0;
+			while (index + 1 < buckets && (value >> index) != 0)
+			{
+				++index;
+			}
+			counts[index].fetch_add (1, std::memory_order_relaxed);
+			sum.fetch_add (value, std::memory_order_relaxed);
+			total.fetch_add (1, std::memory_order_relaxed);
+		}
+		// Values observed which were below 2^index, or all of them for the last bucket
+		uint64_t cumulative (size_t index) const
+		{
+			uint64_t result = 0;
+			for (size_t i = 0; i <= index; ++i)
+			{
+				result += counts[i].load (std::memory_order_relaxed);
+			}
+			return result;
+		}
+	};
+private:
+	static inline std::array<std::atomic<uint64_t>, static_cast<size_t> (counter::size)> counters{};
+	static inline std::array<histogram, static_cast<size_t> (measure::size)> histograms{};
+	static char const * name (counter value)
+	{
+		switch (value)
+		{
+			case counter::edges:
+				return "edges";
+			case counter::ancestors:
+				return "ancestors";
+			case counter::faults:
+				return "faults";
+			default:
+				return "suppressed";
+		}
+	}
+	static char const * name (measure value)
+	{
+		switch (value)
+		{
+			case measure::scan:
+				return "scan";
+			case measure::tally:
+				return "tally";
+			case measure::advance:
+				return "advance";
+			case measure::vote:
+				return "vote";
+			default:
+				return "walk";
+		}
+	}
+public:
+	static void count (counter item, uint64_t value = 1)
+	{
+		counters[static_cast<size_t> (item)].fetch_add (value, std::memory_order_relaxed);
+	}
+	static void observe (measure item, uint64_t value)
+	{
+		histograms[static_cast<size_t> (item)].observe (value);
+	}
+	// Observes the nanoseconds between construction and destruction
+	class timer
+	{
+		measure item;
+		std::chrono::steady_clock::time_point start;
+	public:
+		explicit timer (measure item) :
+		item{ item },
+		start{ std::chrono::steady_clock::now () }
+		{
+		}
+		~timer ()
+		{
+			observe (item, static_cast<uint64_t> (std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now () - start).count ()));
+		}
+	};
+	static uint64_t value (counter item)
+	{
+		return counters[static_cast<size_t> (item)].load (std::memory_order_relaxed);
+	}
+	static histogram const & distribution (measure item)
+	{
+		return histograms[static_cast<size_t> (item)];
+	}
+	static void reset ()
+	{
+		for (auto & item: counters)
+		{
+			item.store (0, std::memory_order_relaxed);
+		}
+		for (auto & item: histograms)
+		{
+			for (auto & count: item.counts)
+			{
+				count.store (0, std::memory_order_relaxed);
+			}
+			item.sum.store (0, std::memory_order_relaxed);
+			item.total.store (0, std::memory_order_relaxed);
+		}
+	}
+	// Writes counters as prefix_name_total and durations as prefix_name_seconds histograms, walk lengths as prefix_walk_length
+	static void write (std::ostream & out, std::string const & prefix = "agreement")
+	{
+		for (size_t i = 0; i < counters.size (); ++i)
+		{
+			auto metric = prefix + '_' + name (static_cast<counter> (i)) + "_total";
+			out << "# TYPE " << metric << " counter\n";
+			out << metric << ' ' << counters[i].load (std::memory_order_relaxed) << '\n';
+		}
+		for (size_t i = 0; i < histograms.size (); ++i)
+		{
+			auto item = static_cast<measure> (i);
+			auto length = item == measure::walk_length;
+			auto metric = prefix + '_' + name (item) + (length ? "_length" : "_seconds");
+			auto const & target = histograms[i];
+			out << "# TYPE " << metric << " histogram\n";
+			for (size_t j = 0; j + 1 < buckets; ++j)
+			{
+				// Bucket j holds integers below 2^j, so up to 2^j - 1
+				auto bound = static_cast<double> ((uint64_t{ 1 } << j) - 1);
+				out << metric << "_bucket{le=\"" << (length ? bound : bound * 1e-9) << "\"} " << target.cumulative (j) << '\n';
+			}
+			out << metric << "_bucket{le=\"+Inf\"} " << target.total.load (std::memory_order_relaxed) << '\n';
+			auto sum = static_cast<double> (target.sum.load (std::memory_order_relaxed));
+			out << metric << "_sum " << (length ? sum : sum * 1e-9) << '\n';
+			out << metric << "_count " << target.total.load (std::memory_order_relaxed) << '\n';
+		}
+	}
+};
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include "simulator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+namespace nano
+{
+// Monte Carlo sweep of simulated rounds over a grid of network parameters
+// Every point of the grid runs the same range of seeds fanned out across threads, each thread with its own simulator
+// Round seed is first + index so any round counted in a table is replayed by simulator.run (seed) with that point's parameters
+template <typename AGREEMENT>
+class sweep
+{
+public:
+	using agreement = AGREEMENT;
+	using simulator = nano::simulator<agreement>;
+	using validators = typename agreement::validators;
+	using validator = typename agreement::validator;
+	using duration = typename agreement::duration;
+	using parameters = typename simulator::parameters;
+	// Builds the validator set for a network of count validators and the key of each of them
+	using population_function = std::function<validators (size_t count)>;
+	using key_function = std::function<validator (size_t index)>;
+	// Values swept on each axis, every combination is a point, parameters not swept come from base
+	class grid
+	{
+	public:
+		std::vector<size_t> validators{ 4 };
+		// Fraction of each network's validators which are faulty, rounded down
+		std::vector<double> faulty{ 0.0 };
+		std::vector<duration> W{ duration{ 50 } };
+		std::vector<duration> hold{ duration{ 101 } };
+		// Upper bound of link latency, the lower bound comes from base
+		std::vector<simulated_clock::duration> delay{ std::chrono::milliseconds{ 20 } };
+	};
+	class point
+	{
+	public:
+		parameters params;
+		size_t validators{ 0 };
+		uint64_t rounds{ 0 };
+		// Rounds where every validator confirmed before the timeout
+		uint64_t live{ 0 };
+		// Rounds where validators confirmed different objects
+		uint64_t conflicts{ 0 };
+		std::optional<uint64_t> first_conflict;
+		// Wall time spent running this point across all threads
+		std::chrono::steady_clock::duration elapsed{};
+		// Time from the start of a round until each validator confirmed, sorted
+		std::vector<simulated_clock::duration> latency;
+		double rate () const
+		{
+			auto seconds = std::chrono::duration<double> (elapsed).count ();
+			return seconds > 0.0 ? rounds / seconds : 0.0;
+		}
+		// Latency at fraction p of confirmations, zero if nothing confirmed
+		simulated_clock::duration percentile (double p) const
+		{
+			if (latency.empty ())
+			{
+				return simulated_clock::duration{};
+			}
+			auto index = std::min (latency.size () - 1, static_cast<size_t> (p * latency.size ()));
+			return latency[index];
+		}
+	};
+private:
+	population_function population;
+	key_function key;
+	parameters base;
+	size_t threads;
+	void run (point & target, uint64_t first, uint64_t rounds)
+	{
+		auto network = population (target.validators);
+		std::vector<validator> keys;
+		for (size_t i = 0; i < target.validators; ++i)
+		{
+			keys.push_back (key (i));
+		}
+		std::mutex mutex;
+		std::atomic<uint64_t> next{ 0 };
+		// Seeds are claimed in chunks so threads rarely touch the shared counter
+		uint64_t const chunk = 256;
+		auto work = [&] () {
+			simulator instance{ network, keys, target.params };
+			point local;
+			std::optional<uint64_t> conflict;
+			for (auto begin = next.fetch_add (chunk); begin < rounds; begin = next.fetch_add (chunk))
+			{
+				for (auto i = begin, end = std::min (rounds, begin + chunk); i < end; ++i)
+				{
+					auto const & result = instance.run (first + i);
+					++local.rounds;
+					local.live += result.live;
+					if (!result.safe ())
+					{
+						++local.conflicts;
+						conflict = std::min (conflict.value_or (result.seed), result.seed);
+					}
+					for (auto const & latency: result.latency)
+					{
+						if (latency)
+						{
+							local.latency.push_back (*latency);
+						}
+					}
+				}
+			}
+			std::lock_guard<std::mutex> lock{ mutex };
+			target.rounds += local.rounds;
+			target.live += local.live;
+			target.conflicts += local.conflicts;
+			if (conflict)
+			{
+				target.first_conflict = std::min (target.first_conflict.value_or (*conflict), *conflict);
+			}
+			target.latency.insert (target.latency.end (), local.latency.begin (), local.latency.end ());
+		};
+		auto start = std::chrono::steady_clock::now ();
+		std::vector<std::thread> workers;
+		for (size_t i = 1; i < threads; ++i)
+		{
+			workers.emplace_back (work);
+		}
+		work ();
+		for (auto & worker: workers)
+		{
+			worker.join ();
+		}
+		target.elapsed = std::chrono::steady_clock::now () - start;
+		std::sort (target.latency.begin (), target.latency.end ());
+	}
+public:
+	sweep (population_function const & population, key_function const & key, parameters const & base, size_t threads = std::max (1u, std::thread::hardware_concurrency ())) :
+	population{ population },
+	key{ key },
+	base{ base },
+	threads{ std::max<size_t> (1, threads) }
+	{
+	}
+	// Runs rounds seeded first through first + rounds - 1 at every point of grid
+	std::vector<point> run (grid const & axes, uint64_t rounds, uint64_t first = 0)
+	{
+		std::vector<point> result;
+		for (auto count: axes.validators)
+		{
+			for (auto fraction: axes.faulty)
+			{
+				for (auto const & W: axes.W)
+				{
+					for (auto const & hold: axes.hold)
+					{
+						for (auto const & delay: axes.delay)
+						{
+							point target;
+							target.validators = count;
+							target.params = base;
+							target.params.faulty = static_cast<size_t> (fraction * count);
+							target.params.W = W;
+							target.params.hold = hold;
+							target.params.latency_max = std::max (base.latency_min, delay);
+							run (target, first, rounds);
+							result.push_back (std::move (target));
+						}
+					}
+				}
+			}
+		}
+		return result;
+	}
+	// Writes one CSV row per point, durations in milliseconds and an empty first_conflict when every round was safe
+	static void write (std::ostream & out, std::vector<point> const & points)
+	{
+		auto ms = [] (auto const & value) { return std::chrono::duration<double, std::milli> (value).count (); };
+		out << "validators,faulty,W,hold,delay,rounds,rounds_per_s,live_rate,conflict_rate,p50,p90,p99,max,first_conflict\n";
+		for (auto const & item: points)
+		{
+			out << item.validators << ',' << item.params.faulty << ',' << ms (item.params.W) << ',' << ms (item.params.hold) << ',' << ms (item.params.latency_max) << ',';
+			out << item.rounds << ',' << item.rate () << ',';
+			out << (item.rounds ? static_cast<double> (item.live) / item.rounds : 0.0) << ',' << (item.rounds ? static_cast<double> (item.conflicts) / item.rounds : 0.0) << ',';
+			out << ms (item.percentile (0.5)) << ',' << ms (item.percentile (0.9)) << ',' << ms (item.percentile (0.99)) << ',' << ms (item.percentile (1.0)) << ',';
+			if (item.first_conflict)
+			{
+				out << *item.first_conflict;
+			}
+			out << '\n';
+		}
+	}
+};
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+namespace nano
+{
+// Hierarchical timer wheel firing values once CLOCK reaches the time they were scheduled for
+// Time is measured in DURATION ticks since CLOCK's epoch, four levels of 256 slots cover 2^32 ticks and later timers wait in an overflow list
+// Each elections worker keeps one to run an election only once time reaches agreement::due or, with a voter set, one tick after the time returned by agreement::vote
+template <typename CLOCK, typename DURATION, typename VALUE>
+class timer_wheel
+{
+public:
+	using clock = CLOCK;
+	using duration = DURATION;
+	using time_point = typename clock::time_point;
+	using value_type = VALUE;
+private:
+	static unsigned constexpr bits = 8;
+	static unsigned constexpr levels = 4;
+	static uint64_t constexpr slots = uint64_t{ 1 } << bits;
+	static uint64_t constexpr mask = slots - 1;
+	class entry
+	{
+	public:
+		uint64_t tick;
+		value_type value;
+	};
+	std::array<std::array<std::vector<entry>, slots>, levels> wheel;
+	std::array<size_t, levels> counts{};
+	std::vector<entry> overflow;
+	// Entries due at current, fired before the next advance returns
+	std::vector<entry> due;
+	uint64_t current;
+	static uint64_t ticks (time_point const & time)
+	{
+		auto result = std::chrono::duration_cast<duration> (time.time_since_epoch ()).count ();
+		return result < 0 ? 0 : static_cast<uint64_t> (result);
+	}
+	// Files item in the slot of the highest level where its tick differs from current
+	void place (entry && item)
+	{
+		if (item.tick <= current)
+		{
+			due.push_back (std::move (item));
+			return;
+		}
+		auto difference = item.tick ^ current;
+		unsigned level = 0;
+		while (level < levels && (difference >> (bits * (level + 1))) != 0)
+		{
+			++level;
+		}
+		if (level < levels)
+		{
+			wheel[level][(item.tick >> (bits * level)) & mask].push_back (std::move (item));
+			++counts[level];
+		}
+		else
+		{
+			overflow.push_back (std::move (item));
+		}
+	}
+	// Redistributes the slot of each level that current just entered
+	void cascade ()
+	{
+		for (unsigned level = 1; level < levels && ((current >> (bits * level)) << (bits * level)) == current; ++level)
+		{
+			auto & slot = wheel[level][(current >> (bits * level)) & mask];
+			counts[level] -= slot.size ();
+			auto items = std::move (slot);
+			slot.clear ();
+			for (auto & item: items)
+			{
+				place (std::move (item));
+			}
+		}
+		if ((current & ((uint64_t{ 1 } << (bits * levels)) - 1)) == 0 && !overflow.empty ())
+		{
+			auto items = std::move (overflow);
+			overflow.clear ();
+			for (auto & item: items)
+			{
+				place (std::move (item));
+			}
+		}
+	}
+	// Last tick before target that can be skipped to without passing any level holding entries
+	uint64_t skip (uint64_t target) const
+	{
+		unsigned level = 0;
+		while (level < levels && counts[level] == 0)
+		{
+			++level;
+		}
+		if (level == 0)
+		{
+			return current;
+		}
+		auto span = level < levels ? (uint64_t{ 1 } << (bits * level)) - 1 : overflow.empty () ? ~uint64_t{ 0 } : (uint64_t{ 1 } << (bits * levels)) - 1;
+		return std::max (current, std::min (target - 1, current | span));
+	}
+public:
+	timer_wheel (time_point const & start) :
+	current{ ticks (start) }
+	{
+	}
+	// Schedules value to fire at the first advance reaching when, values already due fire at the next advance
+	void schedule (time_point const & when, value_type const & value)
+	{
+		place (entry{ ticks (when), value });
+	}
+	// Moves the wheel forward to now calling f (value) for every value due, in order of their scheduled times
+	// Values scheduled by f for a time not after now fire during the same call
+	template<typename UnaryFunction>
+	size_t advance (time_point const & now, UnaryFunction f)
+	{
+		size_t result = 0;
+		auto target = ticks (now);
+		auto fire = [this, &f, &result] () {
+			while (!due.empty ())
+			{
+				auto items = std::move (due);
+				due.clear ();
+				for (auto & item: items)
+				{
+					++result;
+					f (item.value);
+				}
+			}
+		};
+		fire ();
+		while (current < target)
+		{
+			current = skip (target) + 1;
+			cascade ();
+			auto & slot = wheel[0][current & mask];
+			counts[0] -= slot.size ();
+			std::move (slot.begin (), slot.end (), std::back_inserter (due));
+			slot.clear ();
+			fire ();
+		}
+		return result;
+	}
+	// Number of values waiting to fire
+	size_t size () const
+	{
+		size_t result = overflow.size () + due.size ();
+		for (auto count: counts)
+		{
+			result += count;
+		}
+		return result;
+	}
+};
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define NANO_WEIGHT_SUM_X86
+#include <immintrin.h>
+#endif
+
+namespace nano
+{
+// Sums of validator weights over dense per-validator arrays, used for full re-tallies of large validator sets
+namespace weight_sum
+{
+enum class isa
+{
+	scalar,
+	sse2,
+	avx2
+};
+inline char const * name (isa value)
+{
+	switch (value)
+	{
+		case isa::sse2:
+			return "sse2";
+		case isa::avx2:
+			return "avx2";
+		default:
+			return "scalar";
+	}
+}
+// Sum of weights[i] for every i in [0, count) where ids[i] == id
+template<typename WEIGHT>
+WEIGHT scalar (uint32_t const * ids, WEIGHT const * weights, size_t count, uint32_t id)
+{
+	WEIGHT result{ 0 };
+	for (size_t i = 0; i < count; ++i)
+	{
+		result += ids[i] == id ? weights[i] : WEIGHT{ 0 };
+	}
+	return result;
+}
+#ifdef NANO_WEIGHT_SUM_X86
+// SSE2 is part of x86-64 so this needs no runtime check
+inline uint32_t sse2 (uint32_t const * ids, uint32_t const * weights, size_t count, uint32_t id)
+{
+	auto key = _mm_set1_epi32 (static_cast<int> (id));
+	auto total = _mm_setzero_si128 ();
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		auto match = _mm_cmpeq_epi32 (_mm_loadu_si128 (reinterpret_cast<__m128i const *> (ids + i)), key);
+		total = _mm_add_epi32 (total, _mm_and_si128 (match, _mm_loadu_si128 (reinterpret_cast<__m128i const *> (weights + i))));
+	}
+	total = _mm_add_epi32 (total, _mm_shuffle_epi32 (total, 0x4e));
+	total = _mm_add_epi32 (total, _mm_shuffle_epi32 (total, 0xb1));
+	return static_cast<uint32_t> (_mm_cvtsi128_si32 (total)) + scalar (ids + i, weights + i, count - i, id);
+}
+__attribute__((target ("avx2"))) inline uint32_t avx2 (uint32_t const * ids, uint32_t const * weights, size_t count, uint32_t id)
+{
+	auto key = _mm256_set1_epi32 (static_cast<int> (id));
+	auto total = _mm256_setzero_si256 ();
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		auto match = _mm256_cmpeq_epi32 (_mm256_loadu_si256 (reinterpret_cast<__m256i const *> (ids + i)), key);
+		total = _mm256_add_epi32 (total, _mm256_and_si256 (match, _mm256_loadu_si256 (reinterpret_cast<__m256i const *> (weights + i))));
+	}
+	auto half = _mm_add_epi32 (_mm256_castsi256_si128 (total), _mm256_extracti128_si256 (total, 1));
+	half = _mm_add_epi32 (half, _mm_shuffle_epi32 (half, 0x4e));
+	half = _mm_add_epi32 (half, _mm_shuffle_epi32 (half, 0xb1));
+	return static_cast<uint32_t> (_mm_cvtsi128_si32 (half)) + scalar (ids + i, weights + i, count - i, id);
+}
+#endif
+// Widest kernel the running CPU supports, detected once
+inline isa best ()
+{
+#ifdef NANO_WEIGHT_SUM_X86
+	static isa const result = __builtin_cpu_supports ("avx2") ? isa::avx2 : isa::sse2;
+	return result;
+#else
+	return isa::scalar;
+#endif
+}
+// Dispatches to the widest kernel available for WEIGHT, vector kernels add 32-bit lanes so only 32-bit weights use them
+template<typename WEIGHT>
+WEIGHT sum (uint32_t const * ids, WEIGHT const * weights, size_t count, uint32_t id, isa use = best ())
+{
+	static_assert (std::is_integral<WEIGHT>::value, "Validator weights must be an integral type");
+#ifdef NANO_WEIGHT_SUM_X86
+	if constexpr (sizeof (WEIGHT) == sizeof (uint32_t))
+	{
+		// Signed and unsigned 32-bit weights share the same modular addition
+		auto lanes = reinterpret_cast<uint32_t const *> (weights);
+		switch (use)
+		{
+			case isa::avx2:
+				return static_cast<WEIGHT> (avx2 (ids, lanes, count, id));
+			case isa::sse2:
+				return static_cast<WEIGHT> (sse2 (ids, lanes, count, id));
+			default:
+				break;
+		}
+	}
+#endif
+	return scalar (ids, weights, count, id);
+}
+}
+}